@@ -55,13 +55,21 @@ LOCAL_SRC_FILES := \
 	common/core/internaldisplay.cpp \
 	common/core/virtualdisplay.cpp \
 	common/core/gpudevice.cpp \
+	common/core/fencebackend.cpp \
 	common/core/nativesync.cpp \
+	common/core/swsyncfencebackend.cpp \
+	common/core/syncobjfencebackend.cpp \
+	common/core/userfencebackend.cpp \
 	common/core/overlaylayer.cpp \
 	common/display/displayplane.cpp \
 	common/display/displayplanemanager.cpp \
+	common/display/drmpropertyregistry.cpp \
 	common/display/overlaybuffer.cpp \
 	common/display/pageflipeventhandler.cpp \
+	common/display/planecostmodel.cpp \
+	common/display/planeallocationstrategy.cpp \
 	common/utils/drmscopedtypes.cpp \
+	common/utils/bufferimportcache.cpp \
 	common/utils/hwcthread.cpp \
 	common/utils/disjoint_layers.cpp \
 	os/android/grallocbufferhandler.cpp \
@@ -84,7 +92,8 @@ endif
 
 ifeq ($(strip $(BOARD_USES_VULKAN)),)
 LOCAL_CPPFLAGS += \
-	-DUSE_GL
+	-DUSE_GL \
+	-DPROGRAM_BINARY_CACHE_DIR=\"/data/misc/hwc\"
 
 LOCAL_SRC_FILES += \
 	common/compositor/gl/glprogram.cpp \
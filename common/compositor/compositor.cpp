@@ -16,11 +16,14 @@
 
 #include "compositor.h"
 
+#include <algorithm>
+
 #include <xf86drmMode.h>
 
 #include "disjoint_layers.h"
 #include "displayplanestate.h"
 #include "hwctrace.h"
+#include "hwcutils.h"
 #include "nativegpuresource.h"
 #include "nativesurface.h"
 #include "nativesync.h"
@@ -31,6 +34,38 @@
 
 namespace hwcomposer {
 
+// Number of frames of damage kept around. Surfaces which were last rendered
+// longer ago than this are redrawn completely.
+static const size_t kMaxDamageHistory = 8;
+
+static bool IsEmpty(const HwcRect<int> &rect) {
+  return rect.right <= rect.left || rect.bottom <= rect.top;
+}
+
+static void AddDamage(const HwcRect<int> &rect, HwcRect<int> *damage) {
+  if (IsEmpty(rect))
+    return;
+
+  if (IsEmpty(*damage)) {
+    *damage = rect;
+    return;
+  }
+
+  damage->left = std::min(damage->left, rect.left);
+  damage->top = std::min(damage->top, rect.top);
+  damage->right = std::max(damage->right, rect.right);
+  damage->bottom = std::max(damage->bottom, rect.bottom);
+}
+
+static HwcRect<int> Intersect(const HwcRect<int> &a, const HwcRect<int> &b) {
+  HwcRect<int> rect(std::max(a.left, b.left), std::max(a.top, b.top),
+                    std::min(a.right, b.right), std::min(a.bottom, b.bottom));
+  if (IsEmpty(rect))
+    return HwcRect<int>(0, 0, 0, 0);
+
+  return rect;
+}
+
 Compositor::Compositor() {
 }
 
@@ -58,14 +93,41 @@ bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
                       std::vector<OverlayLayer> &layers,
                       const std::vector<HwcRect<int>> &display_frame) {
   const DisplayPlaneState *comp = NULL;
-  std::vector<size_t> dedicated_layers;
+  dedicated_layers_.clear();
+  // Layers which end up on a plane we render to, the only ones which need
+  // GPU resources.
+  render_layers_.clear();
+  for (DisplayPlaneState &plane : comp_planes) {
+    if (plane.GetCompositionState() != DisplayPlaneState::State::kRender)
+      continue;
+
+    if (plane.IsOffScreenTargetValid()) {
+      plane.GetOffScreenTarget()->SetRenderedFrame(
+          frame_, plane.GetOffScreenTarget()->GetRegionsSignature());
+    } else {
+      render_layers_.insert(render_layers_.end(),
+                            plane.source_layers().begin(),
+                            plane.source_layers().end());
+    }
+  }
+
+  // Nothing changed on any render plane, the targets from the last frame
+  // are shown again without touching the GPU.
+  if (render_layers_.empty())
+    return true;
+
+  std::sort(render_layers_.begin(), render_layers_.end());
+  render_layers_.erase(
+      std::unique(render_layers_.begin(), render_layers_.end()),
+      render_layers_.end());
+
   ScopedRendererState state(renderer_.get());
   if (!state.IsValid()) {
     ETRACE("Failed to draw as Renderer doesnt have a valid context.");
     return false;
   }
 
-  if (!gpu_resource_handler_->PrepareResources(layers)) {
+  if (!gpu_resource_handler_->PrepareResources(layers, render_layers_)) {
     ETRACE(
         "Failed to prepare GPU resources for compositing the frame, "
         "error: %s",
@@ -75,29 +137,131 @@ bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
 
   for (DisplayPlaneState &plane : comp_planes) {
     if (plane.GetCompositionState() == DisplayPlaneState::State::kScanout) {
-      dedicated_layers.insert(dedicated_layers.end(),
-                              plane.source_layers().begin(),
-                              plane.source_layers().end());
+      dedicated_layers_.insert(dedicated_layers_.end(),
+                               plane.source_layers().begin(),
+                               plane.source_layers().end());
     } else if (plane.GetCompositionState() ==
                DisplayPlaneState::State::kRender) {
+      if (plane.IsOffScreenTargetValid()) {
+        dedicated_layers_.clear();
+        continue;
+      }
+
       comp = &plane;
-      std::vector<CompositionRegion> comp_regions;
-      SeparateLayers(dedicated_layers, comp->source_layers(), display_frame,
-                     comp_regions);
-      std::vector<size_t>().swap(dedicated_layers);
-      if (comp_regions.empty())
+      SeparateLayers(dedicated_layers_, comp->source_layers(), display_frame,
+                     comp_regions_);
+      dedicated_layers_.clear();
+      NativeSurface *surface = plane.GetOffScreenTarget();
+      if (comp_regions_.empty()) {
+        surface->SetRenderedFrame(0, 0);
         continue;
+      }
+
+      const HwcRect<int> &target_frame = plane.GetDisplayFrame();
+      uint64_t signature = HashCombine(0, comp_regions_.size());
+      for (int i = 0; i < 4; i++)
+        signature = HashCombine(signature, target_frame.bounds[i]);
 
-      if (!Render(layers, plane.GetOffScreenTarget(), comp_regions)) {
+      for (const CompositionRegion &region : comp_regions_) {
+        for (int i = 0; i < 4; i++)
+          signature = HashCombine(signature, region.frame.bounds[i]);
+
+        for (size_t source_layer : region.source_layers)
+          signature = HashCombine(signature, source_layer);
+      }
+
+      // Only the part of the surface which changed since it was last
+      // rendered needs to be cleared and drawn again.
+      HwcRect<int> damage = GetSurfaceDamage(surface, target_frame, signature);
+      damaged_regions_.clear();
+      for (CompositionRegion &region : comp_regions_) {
+        HwcRect<int> frame = Intersect(region.frame, damage);
+        if (IsEmpty(frame))
+          continue;
+
+        // Swapped rather than moved, both vectors keep their storage.
+        CompositionRegion &damaged = damaged_regions_.emplace_back();
+        damaged.frame = frame;
+        damaged.source_layers.swap(region.source_layers);
+      }
+
+      surface->SetDamage(damage);
+      if (!Render(layers, surface, damaged_regions_)) {
         ETRACE("Failed to Render layer.");
+        surface->SetRenderedFrame(0, 0);
         return false;
       }
+
+      surface->SetRenderedFrame(frame_, signature);
     }
   }
 
   return true;
 }
 
+void Compositor::UpdateDamage(const std::vector<OverlayLayer> &layers) {
+  HwcRect<int> damage(0, 0, 0, 0);
+  size_t size = layers.size();
+  bool layers_changed = size != previous_layers_.size();
+  if (layers_changed) {
+    for (const LayerGeometry &geometry : previous_layers_)
+      AddDamage(geometry.display_frame, &damage);
+
+    previous_layers_.resize(size);
+  }
+
+  for (size_t layer_index = 0; layer_index < size; layer_index++) {
+    const OverlayLayer &layer = layers.at(layer_index);
+    LayerGeometry &previous = previous_layers_.at(layer_index);
+    const HwcRect<int> &display_frame = layer.GetDisplayFrame();
+    if (layers_changed) {
+      AddDamage(display_frame, &damage);
+    } else if (!(previous.display_frame == display_frame) ||
+               !(previous.source_crop == layer.GetSourceCrop()) ||
+               previous.transform != layer.GetTransform() ||
+               previous.alpha != layer.GetAlpha() ||
+               previous.blending != layer.GetBlending()) {
+      AddDamage(previous.display_frame, &damage);
+      AddDamage(display_frame, &damage);
+    } else {
+      AddDamage(layer.GetSurfaceDamage(), &damage);
+    }
+
+    previous.display_frame = display_frame;
+    previous.source_crop = layer.GetSourceCrop();
+    previous.transform = layer.GetTransform();
+    previous.alpha = layer.GetAlpha();
+    previous.blending = layer.GetBlending();
+  }
+
+  frame_++;
+  if (damage_history_.size() < kMaxDamageHistory)
+    damage_history_.emplace_back(damage);
+  else
+    damage_history_.back() = damage;
+
+  std::rotate(damage_history_.begin(), damage_history_.end() - 1,
+              damage_history_.end());
+}
+
+HwcRect<int> Compositor::GetSurfaceDamage(const NativeSurface *surface,
+                                          const HwcRect<int> &target_frame,
+                                          uint64_t regions_signature) const {
+  uint64_t rendered_frame = surface->GetRenderedFrame();
+  if (!rendered_frame || surface->GetRegionsSignature() != regions_signature)
+    return target_frame;
+
+  uint64_t age = frame_ - rendered_frame;
+  if (age > damage_history_.size())
+    return target_frame;
+
+  HwcRect<int> damage(0, 0, 0, 0);
+  for (size_t i = 0; i < age; i++)
+    AddDamage(damage_history_.at(i), &damage);
+
+  return Intersect(damage, target_frame);
+}
+
 bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
                                const std::vector<HwcRect<int>> &display_frame,
                                const std::vector<size_t> &source_layers,
@@ -111,7 +275,7 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
     return false;
   }
 
-  if (!gpu_resource_handler_->PrepareResources(layers)) {
+  if (!gpu_resource_handler_->PrepareResources(layers, source_layers)) {
     ETRACE(
         "Failed to prepare GPU resources for compositing the frame, "
         "error: %s",
@@ -119,10 +283,9 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
     return false;
   }
 
-  std::vector<CompositionRegion> comp_regions;
   SeparateLayers(std::vector<size_t>(), source_layers, display_frame,
-                 comp_regions);
-  if (comp_regions.empty()) {
+                 comp_regions_);
+  if (comp_regions_.empty()) {
     ETRACE(
         "Failed to prepare offscreen buffer. "
         "error: %s",
@@ -133,7 +296,7 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
   std::unique_ptr<NativeSurface> surface(CreateBackBuffer(width, height));
   surface->InitializeForOffScreenRendering(buffer_handler, output_handle);
 
-  if (!Render(layers, surface.get(), comp_regions))
+  if (!Render(layers, surface.get(), comp_regions_))
     return false;
 
   *retire_fence = surface->ReleaseNativeFence();
@@ -147,25 +310,14 @@ void Compositor::InsertFence(int fence) {
 
 bool Compositor::Render(std::vector<OverlayLayer> &layers,
                         NativeSurface *surface,
-                        const std::vector<CompositionRegion> &comp_regions) {
-  std::vector<RenderState> states;
-  size_t num_regions = comp_regions.size();
-  states.reserve(num_regions);
-
-  for (size_t region_index = 0; region_index < num_regions; region_index++) {
-    const CompositionRegion &region = comp_regions.at(region_index);
-    RenderState state;
+                        const FrameVector<CompositionRegion> &comp_regions) {
+  states_.clear();
+  for (const CompositionRegion &region : comp_regions) {
+    RenderState &state = states_.emplace_back();
     state.ConstructState(layers, region, gpu_resource_handler_.get());
-    auto it = states.begin();
-    for (; it != states.end(); ++it) {
-      if (state.layer_state_.size() > it->layer_state_.size())
-        break;
-    }
-
-    states.emplace(it, state);
   }
 
-  if (!renderer_->Draw(states, surface))
+  if (!renderer_->Draw(states_, surface))
     return false;
 
   surface->GetLayer()->SetAcquireFence(surface->ReleaseNativeFence());
@@ -173,84 +325,122 @@ bool Compositor::Render(std::vector<OverlayLayer> &layers,
 }
 
 // Below code is taken from drm_hwcomposer adopted to our needs.
-static std::vector<size_t> SetBitsToVector(
-    uint64_t in, const std::vector<size_t> &index_map) {
-  std::vector<size_t> out;
-  size_t msb = sizeof(in) * 8 - 1;
-  uint64_t mask = (uint64_t)1 << msb;
-  for (size_t i = msb; mask != (uint64_t)0; i--, mask >>= 1)
-    if (in & mask)
-      out.emplace_back(index_map[i]);
-  return out;
+// Appends the layers of |in| from |offset| on, topmost first.
+template <typename TIds>
+static void SetBitsToVector(const TIds &in, size_t offset,
+                            const std::vector<size_t> &index_map,
+                            std::vector<size_t> *out) {
+  out->clear();
+  for (size_t word = TIds::words; word-- > 0;) {
+    uint64_t bits = in.getWord(word);
+    if (!bits)
+      continue;
+
+    for (size_t bit = 64; bit-- > 0;) {
+      size_t i = word * 64 + bit;
+      if (i >= offset && (bits & ((uint64_t)1 << bit)))
+        out->emplace_back(index_map[i - offset]);
+    }
+  }
+}
+
+// Turns the regions get_draw_regions() split |layer_rects| into, the
+// dedicated layers first and the source layers from |layer_offset| on, into
+// composition regions of source layers.
+template <typename TIds>
+static void AddCompositionRegions(
+    std::vector<RectSet<int, TIds>> &regions,
+    const std::vector<size_t> &dedicated_layers,
+    const std::vector<size_t> &source_layers,
+    FrameVector<CompositionRegion> &comp_regions) {
+  size_t layer_offset = dedicated_layers.size();
+  if (layer_offset) {
+    for (RectSet<int, TIds> &region : regions) {
+      // If a rect intersects one of the dedicated layers, we need to remove
+      // the layers from the composition region which appear *below* the
+      // dedicated layer. This effectively punches a hole through the
+      // composition layer such that the dedicated layer can be placed below
+      // the composition and not be occluded.
+      for (size_t i = 0; i < dedicated_layers.size(); ++i) {
+        // Only exclude layers if they intersect this particular dedicated
+        // layer
+        if (!region.id_set.contains(i))
+          continue;
+
+        region.id_set.subtract(i);
+        for (size_t j = 0; j < source_layers.size(); ++j) {
+          if (source_layers[j] < dedicated_layers[i])
+            region.id_set.subtract(j + layer_offset);
+        }
+      }
+    }
+
+    regions.erase(std::remove_if(regions.begin(), regions.end(),
+                                 [](const RectSet<int, TIds> &region) {
+                                   return region.id_set.isEmpty();
+                                 }),
+                  regions.end());
+
+    // The hole leaves a layer overlapping a dedicated one split along the
+    // dedicated layer's edges into regions with the same source layers,
+    // each of which would be drawn on its own.
+#ifdef COMPOSITOR_TRACING
+    size_t separate_regions = regions.size();
+#endif
+    merge_draw_regions(&regions);
+    ICOMPOSITORTRACE("Merged %zu composition regions into %zu",
+                     separate_regions, regions.size());
+  }
+
+  for (const RectSet<int, TIds> &region : regions) {
+    CompositionRegion &comp_region = comp_regions.emplace_back();
+    comp_region.frame = region.rect;
+    SetBitsToVector(region.id_set, layer_offset, source_layers,
+                    &comp_region.source_layers);
+  }
 }
 
 void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
                                 const std::vector<size_t> &source_layers,
                                 const std::vector<HwcRect<int>> &display_frame,
-                                std::vector<CompositionRegion> &comp_regions) {
-  if (source_layers.size() > 64) {
-    ETRACE("Failed to separate layers because there are more than 64");
-    return;
-  }
-
-  size_t num_exclude_rects = 0;
+                                FrameVector<CompositionRegion> &comp_regions) {
+  comp_regions.clear();
   // Index at which the actual layers begin
   size_t layer_offset = dedicated_layers.size();
-  if (source_layers.size() + layer_offset > 64) {
-    WTRACE(
-        "Exclusion rectangles are being truncated to make the rectangle count "
-        "fit into 64");
-    num_exclude_rects = 64 - source_layers.size() - dedicated_layers.size();
+  size_t num_rects = source_layers.size() + layer_offset;
+  if (num_rects > WideRectIDs::max_elements) {
+    ETRACE("Failed to separate layers because there are more than %d",
+           WideRectIDs::max_elements);
+    return;
   }
 
-  // We inject all the exclude rects into the rects list. Any resulting rect
-  // that includes ANY of the first num_exclude_rects is rejected. After the
-  // exclude rects, we add the lower layers. The rects that intersect with
-  // these layers will be inspected and only those which are to be composited
-  // above the layer will be included in the composition regions.
-  std::vector<HwcRect<int>> layer_rects(source_layers.size() + layer_offset);
+  // The dedicated layers come first, followed by the source layers. The
+  // rects that intersect with the dedicated layers will be inspected and
+  // only those source layers which are to be composited above the layer
+  // will be included in the composition regions.
+  layer_rects_.resize(num_rects);
   std::transform(
-      dedicated_layers.begin(), dedicated_layers.end(),
-      layer_rects.begin() + num_exclude_rects,
+      dedicated_layers.begin(), dedicated_layers.end(), layer_rects_.begin(),
       [=](size_t layer_index) { return display_frame[layer_index]; });
   std::transform(source_layers.begin(), source_layers.end(),
-                 layer_rects.begin() + layer_offset, [=](size_t layer_index) {
+                 layer_rects_.begin() + layer_offset, [=](size_t layer_index) {
     return display_frame[layer_index];
   });
 
-  std::vector<RectSet<int>> separate_regions;
-  get_draw_regions(layer_rects, &separate_regions);
-  uint64_t exclude_mask = ((uint64_t)1 << num_exclude_rects) - 1;
-  uint64_t dedicated_mask = (((uint64_t)1 << dedicated_layers.size()) - 1)
-                            << num_exclude_rects;
-
-  for (RectSet<int> &region : separate_regions) {
-    if (region.id_set.getBits() & exclude_mask)
-      continue;
-
-    // If a rect intersects one of the dedicated layers, we need to remove the
-    // layers from the composition region which appear *below* the dedicated
-    // layer. This effectively punches a hole through the composition layer such
-    // that the dedicated layer can be placed below the composition and not
-    // be occluded.
-    uint64_t dedicated_intersect = region.id_set.getBits() & dedicated_mask;
-    for (size_t i = 0; dedicated_intersect && i < dedicated_layers.size();
-         ++i) {
-      // Only exclude layers if they intersect this particular dedicated layer
-      if (!(dedicated_intersect & (1 << (i + num_exclude_rects))))
-        continue;
-
-      for (size_t j = 0; j < source_layers.size(); ++j) {
-        if (source_layers[j] < dedicated_layers[i])
-          region.id_set.subtract(j + layer_offset);
-      }
-    }
-    if (!(region.id_set.getBits() >> layer_offset))
-      continue;
-
-    comp_regions.emplace_back(CompositionRegion{
-        region.rect, SetBitsToVector(region.id_set.getBits() >> layer_offset,
-                                     source_layers)});
+  // One word of ids covers almost every frame, only planes with more
+  // layers pay for the wide sets.
+  if (num_rects <= RectIDs::max_elements) {
+    separate_regions_.clear();
+    get_draw_regions(layer_rects_, &draw_regions_scratch_,
+                     &separate_regions_);
+    AddCompositionRegions(separate_regions_, dedicated_layers, source_layers,
+                          comp_regions);
+  } else {
+    wide_separate_regions_.clear();
+    get_draw_regions(layer_rects_, &wide_draw_regions_scratch_,
+                     &wide_separate_regions_);
+    AddCompositionRegions(wide_separate_regions_, dedicated_layers,
+                          source_layers, comp_regions);
   }
 }
 }
@@ -20,8 +20,11 @@
 #include <platformdefines.h>
 
 #include "compositionregion.h"
+#include "disjoint_layers.h"
 #include "displayplanestate.h"
 #include "factory.h"
+#include "framevector.h"
+#include "renderstate.h"
 
 namespace hwcomposer {
 
@@ -41,6 +44,9 @@ class Compositor {
   Compositor(const Compositor &) = delete;
 
   bool BeginFrame();
+  // Records which parts of the display change with |layers|. Has to be
+  // called once for every frame, whether it is composited or not.
+  void UpdateDamage(const std::vector<OverlayLayer> &layers);
   bool Draw(DisplayPlaneStateList &planes, std::vector<OverlayLayer> &layers,
             const std::vector<HwcRect<int>> &display_frame);
   bool DrawOffscreen(std::vector<OverlayLayer> &layers,
@@ -53,15 +59,46 @@ class Compositor {
 
  private:
   bool Render(std::vector<OverlayLayer> &layers, NativeSurface *surface,
-              const std::vector<CompositionRegion> &comp_regions);
+              const FrameVector<CompositionRegion> &comp_regions);
   void SeparateLayers(const std::vector<size_t> &dedicated_layers,
                       const std::vector<size_t> &source_layers,
                       const std::vector<HwcRect<int>> &display_frame,
-                      std::vector<CompositionRegion> &comp_regions);
+                      FrameVector<CompositionRegion> &comp_regions);
+  HwcRect<int> GetSurfaceDamage(const NativeSurface *surface,
+                                const HwcRect<int> &target_frame,
+                                uint64_t regions_signature) const;
+
+  // Per layer state of the previous frame. Changes to any of it damage the
+  // old and new display frame of the layer.
+  struct LayerGeometry {
+    HwcRect<int> display_frame;
+    HwcRect<float> source_crop;
+    uint32_t transform;
+    uint8_t alpha;
+    HWCBlending blending;
+  };
 
   InternalDisplay *display_;
   std::unique_ptr<Renderer> renderer_;
   std::unique_ptr<NativeGpuResource> gpu_resource_handler_;
+  std::vector<LayerGeometry> previous_layers_;
+  // Damage of the most recent frames, newest first.
+  std::vector<HwcRect<int>> damage_history_;
+  uint64_t frame_ = 0;
+
+  // Scratch data of the frame being drawn. Kept across frames, so drawing
+  // a frame like the previous one doesn't allocate.
+  std::vector<size_t> dedicated_layers_;
+  std::vector<size_t> render_layers_;
+  std::vector<HwcRect<int>> layer_rects_;
+  std::vector<RectSet<int>> separate_regions_;
+  DrawRegionsScratch draw_regions_scratch_;
+  // Only used by planes with more than 64 layers.
+  std::vector<RectSet<int, WideRectIDs>> wide_separate_regions_;
+  WideDrawRegionsScratch wide_draw_regions_scratch_;
+  FrameVector<CompositionRegion> comp_regions_;
+  FrameVector<CompositionRegion> damaged_regions_;
+  FrameVector<RenderState> states_;
 };
 }
 
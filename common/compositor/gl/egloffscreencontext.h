@@ -26,7 +26,9 @@ class EGLOffScreenContext {
   EGLOffScreenContext();
   ~EGLOffScreenContext();
 
-  bool Init();
+  // Objects like programs are shared with |share_context| unless it is
+  // EGL_NO_CONTEXT.
+  bool Init(EGLContext share_context = EGL_NO_CONTEXT);
 
   bool MakeCurrent();
 
@@ -38,6 +40,10 @@ class EGLOffScreenContext {
     return egl_display_;
   }
 
+  EGLContext GetContext() const {
+    return egl_ctx_;
+  }
+
  private:
   EGLDisplay egl_display_;
   EGLContext egl_ctx_;
@@ -16,14 +16,35 @@
 
 #include "glprogram.h"
 
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
 #include <string>
 #include <sstream>
 
 #include "hwctrace.h"
 #include "renderstate.h"
 
+// Linked programs are cached here between runs.
+#ifndef PROGRAM_BINARY_CACHE_DIR
+#define PROGRAM_BINARY_CACHE_DIR "/var/cache/hwcomposer"
+#endif
+
 namespace hwcomposer {
 
+static const uint32_t kProgramBinaryMagic = 0x50435748;  // "HWCP"
+
+struct ProgramBinaryHeader {
+  uint32_t magic;
+  GLenum format;
+  uint32_t length;
+};
+
 // Shaders adopted from drm_hwcomposer project.
 static GLint CompileAndCheckShader(GLenum type, unsigned source_count,
                                    const GLchar **sources,
@@ -58,27 +79,25 @@ static GLint CompileAndCheckShader(GLenum type, unsigned source_count,
   return shader;
 }
 
+// vPosition is in viewport coordinates from 0 to 1, uLayerCrop maps it to
+// the layer's texture coordinates.
 static std::string GenerateVertexShader(int layer_count) {
   std::ostringstream vertex_shader_stream;
   vertex_shader_stream
       << "#version 300 es\n"
       << "#define LAYER_COUNT " << layer_count << "\n"
       << "precision mediump int;\n"
-      << "uniform vec4 uViewport;\n"
       << "uniform vec4 uLayerCrop[LAYER_COUNT];\n"
       << "uniform mat2 uTexMatrix[LAYER_COUNT];\n"
       << "in vec2 vPosition;\n"
-      << "in vec2 vTexCoords;\n"
       << "out vec2 fTexCoords[LAYER_COUNT];\n"
       << "void main() {\n"
       << "  for (int i = 0; i < LAYER_COUNT; i++) {\n"
-      << "    vec2 tempCoords = vTexCoords * uTexMatrix[i];\n"
+      << "    vec2 tempCoords = vPosition * uTexMatrix[i];\n"
       << "    fTexCoords[i] =\n"
       << "        uLayerCrop[i].xy + tempCoords * uLayerCrop[i].zw;\n"
       << "  }\n"
-      << "  vec2 scaledPosition = uViewport.xy + vPosition * uViewport.zw;\n"
-      << "  gl_Position =\n"
-      << "      vec4(scaledPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
+      << "  gl_Position = vec4(vPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
       << "}\n";
   return vertex_shader_stream.str();
 }
@@ -126,16 +145,86 @@ static std::string GenerateFragmentShader(int layer_count) {
   return fragment_shader_stream.str();
 }
 
-static GLint GenerateProgram(unsigned num_textures,
+static std::string GenerateVertexShader(const GLProgramVariant &variant) {
+  std::ostringstream vertex_shader_stream;
+  vertex_shader_stream
+      << "#version 300 es\n"
+      << "#define LAYER_COUNT " << variant.size() << "\n"
+      << "precision mediump int;\n"
+      << "uniform vec4 uLayerCrop[LAYER_COUNT];\n"
+      << "in vec2 vPosition;\n"
+      << "out vec2 fTexCoords[LAYER_COUNT];\n"
+      << "void main() {\n";
+  for (size_t i = 0; i < variant.size(); ++i) {
+    const char *coords =
+        (variant[i] & kVariantSwapXY) ? "vPosition.yx" : "vPosition";
+    vertex_shader_stream << "  fTexCoords[" << i << "] = uLayerCrop[" << i
+                         << "].xy + " << coords << " * uLayerCrop[" << i
+                         << "].zw;\n";
+  }
+  vertex_shader_stream
+      << "  gl_Position = vec4(vPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
+      << "}\n";
+  return vertex_shader_stream.str();
+}
+
+// Same math as the generic shader, with the premultiply, plane alpha and
+// early out branches resolved at build time.
+static std::string GenerateFragmentShader(const GLProgramVariant &variant) {
+  std::ostringstream fragment_shader_stream;
+  fragment_shader_stream << "#version 300 es\n"
+                         << "#define LAYER_COUNT " << variant.size() << "\n"
+                         << "#extension GL_OES_EGL_image_external : require\n"
+                         << "precision mediump float;\n";
+  for (size_t i = 0; i < variant.size(); ++i) {
+    fragment_shader_stream << "uniform samplerExternalOES uLayerTexture" << i
+                           << ";\n";
+  }
+  fragment_shader_stream << "uniform float uLayerAlpha[LAYER_COUNT];\n"
+                         << "in vec2 fTexCoords[LAYER_COUNT];\n"
+                         << "out vec4 oFragColor;\n"
+                         << "void main() {\n"
+                         << "  vec3 color = vec3(0.0, 0.0, 0.0);\n"
+                         << "  float alphaCover = 1.0;\n"
+                         << "  vec4 texSample;\n";
+  for (size_t i = 0; i < variant.size(); ++i) {
+    uint8_t bits = variant[i];
+    fragment_shader_stream << "  texSample = texture2D(uLayerTexture" << i
+                           << ", fTexCoords[" << i << "]);\n";
+    // Nothing below an opaque layer is visible.
+    if (bits & kVariantOpaque) {
+      fragment_shader_stream << "  color += texSample.rgb * alphaCover;\n"
+                             << "  alphaCover = 0.0;\n";
+      break;
+    }
+
+    std::ostringstream alpha;
+    alpha << "texSample.a";
+    if (bits & kVariantPlaneAlpha)
+      alpha << " * uLayerAlpha[" << i << "]";
+
+    fragment_shader_stream << "  color += texSample.rgb";
+    if (bits & kVariantCoverage)
+      fragment_shader_stream << " * texSample.a";
+    if (bits & kVariantPlaneAlpha)
+      fragment_shader_stream << " * uLayerAlpha[" << i << "]";
+    fragment_shader_stream << " * alphaCover;\n"
+                           << "  alphaCover *= 1.0 - " << alpha.str() << ";\n";
+  }
+  fragment_shader_stream << "  oFragColor = vec4(color, 1.0 - alphaCover);\n"
+                         << "}\n";
+  return fragment_shader_stream.str();
+}
+
+static GLint GenerateProgram(const std::string &vertex_shader_string,
+                             const std::string &fragment_shader_string,
                              std::ostringstream *shader_log) {
-  std::string vertex_shader_string = GenerateVertexShader(num_textures);
   const GLchar *vertex_shader_source = vertex_shader_string.c_str();
   GLint vertex_shader = CompileAndCheckShader(
       GL_VERTEX_SHADER, 1, &vertex_shader_source, shader_log);
   if (!vertex_shader)
     return 0;
 
-  std::string fragment_shader_string = GenerateFragmentShader(num_textures);
   const GLchar *fragment_shader_source = fragment_shader_string.c_str();
   GLint fragment_shader = CompileAndCheckShader(
       GL_FRAGMENT_SHADER, 1, &fragment_shader_source, shader_log);
@@ -155,7 +244,6 @@ static GLint GenerateProgram(unsigned num_textures,
   glAttachShader(program, vertex_shader);
   glAttachShader(program, fragment_shader);
   glBindAttribLocation(program, 0, "vPosition");
-  glBindAttribLocation(program, 1, "vTexCoords");
   glLinkProgram(program);
   glDetachShader(program, vertex_shader);
   glDetachShader(program, fragment_shader);
@@ -179,6 +267,143 @@ static GLint GenerateProgram(unsigned num_textures,
   return program;
 }
 
+// Stable across runs, unlike std::hash.
+static uint64_t HashString(uint64_t hash, const char *string) {
+  if (!string)
+    return hash;
+
+  for (; *string; string++) {
+    hash ^= static_cast<unsigned char>(*string);
+    hash *= 0x100000001b3ULL;
+  }
+
+  return hash;
+}
+
+// Returns the file the binary of the program linked from these sources is
+// cached in. The driver is part of the key, a driver update changes the
+// binary format.
+static std::string GetProgramBinaryPath(const std::string &vertex_shader,
+                                        const std::string &fragment_shader) {
+  uint64_t key = 0xcbf29ce484222325ULL;
+  key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_VENDOR)));
+  key =
+      HashString(key, reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+  key = HashString(key, reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+  key = HashString(key, vertex_shader.c_str());
+  key = HashString(key, fragment_shader.c_str());
+
+  char name[32];
+  snprintf(name, sizeof(name), "/program_%016" PRIx64 ".bin", key);
+  return std::string(PROGRAM_BINARY_CACHE_DIR) + name;
+}
+
+static bool ProgramBinariesSupported() {
+  if (!glGetProgramBinaryOES || !glProgramBinaryOES)
+    return false;
+
+  GLint formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+  return formats > 0;
+}
+
+static GLint LoadProgramBinary(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return 0;
+
+  ProgramBinaryHeader header;
+  std::vector<char> binary;
+  bool read = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == kProgramBinaryMagic && header.length > 0;
+  if (read) {
+    binary.resize(header.length);
+    read = fread(binary.data(), header.length, 1, file) == 1;
+  }
+
+  fclose(file);
+  if (!read)
+    return 0;
+
+  GLint program = glCreateProgram();
+  if (!program)
+    return 0;
+
+  glProgramBinaryOES(program, header.format, binary.data(), header.length);
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    // Stale binary, i.e. from a driver which reports the same version.
+    glDeleteProgram(program);
+    unlink(path.c_str());
+    return 0;
+  }
+
+  return program;
+}
+
+static void StoreProgramBinary(GLint program, const std::string &path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0)
+    return;
+
+  ProgramBinaryHeader header;
+  header.magic = kProgramBinaryMagic;
+  std::vector<char> binary(length);
+  GLsizei written = 0;
+  glGetProgramBinaryOES(program, length, &written, &header.format,
+                        binary.data());
+  if (written <= 0)
+    return;
+
+  header.length = written;
+  if (mkdir(PROGRAM_BINARY_CACHE_DIR, 0700) && errno != EEXIST)
+    return;
+
+  // Written to a temporary file first, so a concurrent load never sees
+  // half a binary. Each writer gets its own one, processes compiling the
+  // same program at once would otherwise write into the same file.
+  std::string temp_path = path + ".XXXXXX";
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0)
+    return;
+
+  FILE *file = fdopen(fd, "wb");
+  if (!file) {
+    close(fd);
+    unlink(temp_path.c_str());
+    return;
+  }
+
+  bool stored = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                fwrite(binary.data(), written, 1, file) == 1;
+  stored &= fclose(file) == 0;
+  if (!stored || rename(temp_path.c_str(), path.c_str())) {
+    ETRACE("Failed to store program binary %s", path.c_str());
+    unlink(temp_path.c_str());
+  }
+}
+
+// crop_bounds_ are the texture coordinates at the corners of the region.
+// Returns them as origin and scale of a mapping from viewport coordinates
+// instead, which is the same for every region a layer is part of.
+static void GetViewportCrop(const RenderState &state,
+                            const RenderState::LayerState &src,
+                            GLuint viewport_width, GLuint viewport_height,
+                            float crop[4]) {
+  float region_origin[2] = {state.x_ / viewport_width,
+                            state.y_ / viewport_height};
+  float region_size[2] = {state.width_ / viewport_width,
+                          state.height_ / viewport_height};
+  for (int i = 0; i < 2; i++) {
+    int axis = src.swap_xy_ ? 1 - i : i;
+    float size = src.crop_bounds_[i + 2] - src.crop_bounds_[i];
+    crop[i + 2] = size / region_size[axis];
+    crop[i] = src.crop_bounds_[i] - region_origin[axis] * crop[i + 2];
+  }
+}
+
 GLProgram::GLProgram() : initialized_(false) {
 }
 
@@ -188,13 +413,37 @@ GLProgram::~GLProgram() {
 }
 
 bool GLProgram::Init(unsigned texture_count) {
+  texture_count_ = texture_count;
+  return Link(GenerateVertexShader(texture_count),
+              GenerateFragmentShader(texture_count));
+}
+
+bool GLProgram::Init(const GLProgramVariant &variant) {
+  texture_count_ = variant.size();
+  return Link(GenerateVertexShader(variant), GenerateFragmentShader(variant));
+}
+
+bool GLProgram::Link(const std::string &vertex_shader,
+                     const std::string &fragment_shader) {
+  bool cache_binary = ProgramBinariesSupported();
+  std::string binary_path;
+  if (cache_binary) {
+    binary_path = GetProgramBinaryPath(vertex_shader, fragment_shader);
+    program_ = LoadProgramBinary(binary_path);
+    if (program_)
+      return true;
+  }
+
   std::ostringstream shader_log;
-  program_ = GenerateProgram(texture_count, &shader_log);
+  program_ = GenerateProgram(vertex_shader, fragment_shader, &shader_log);
   if (!program_) {
     ETRACE("%s", shader_log.str().c_str());
     return false;
   }
 
+  if (cache_binary)
+    StoreProgramBinary(program_, binary_path);
+
   return true;
 }
 
@@ -203,12 +452,20 @@ void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
   glUseProgram(program_);
   unsigned size = state.layer_state_.size();
   if (!initialized_) {
-    viewport_loc_ = glGetUniformLocation(program_, "uViewport");
-    crop_loc_ = glGetUniformLocation(program_, "uLayerCrop");
-    alpha_loc_ = glGetUniformLocation(program_, "uLayerAlpha");
-    premult_loc_ = glGetUniformLocation(program_, "uLayerPremult");
-    tex_matrix_loc_ = glGetUniformLocation(program_, "uTexMatrix");
-    for (unsigned src_index = 0; src_index < size; src_index++) {
+    layer_uniforms_.resize(texture_count_);
+    for (unsigned src_index = 0; src_index < texture_count_; src_index++) {
+      LayerUniforms &uniforms = layer_uniforms_[src_index];
+      std::ostringstream index;
+      index << "[" << src_index << "]";
+      uniforms.crop_loc = glGetUniformLocation(
+          program_, ("uLayerCrop" + index.str()).c_str());
+      uniforms.alpha_loc = glGetUniformLocation(
+          program_, ("uLayerAlpha" + index.str()).c_str());
+      uniforms.premult_loc = glGetUniformLocation(
+          program_, ("uLayerPremult" + index.str()).c_str());
+      uniforms.tex_matrix_loc = glGetUniformLocation(
+          program_, ("uTexMatrix" + index.str()).c_str());
+
       std::ostringstream texture_name_formatter;
       texture_name_formatter << "uLayerTexture" << src_index;
       GLuint tex_loc =
@@ -219,23 +476,68 @@ void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
     initialized_ = true;
   }
 
-  glUniform4f(viewport_loc_, state.x_ / (float)viewport_width,
-              state.y_ / (float)viewport_height,
-              (state.width_) / (float)viewport_width,
-              (state.height_) / (float)viewport_height);
-
   for (unsigned src_index = 0; src_index < size; src_index++) {
     const RenderState::LayerState &src = state.layer_state_[src_index];
-    glUniform1f(alpha_loc_ + src_index, src.alpha_);
-    glUniform1f(premult_loc_ + src_index, src.premult_);
-    glUniform4f(crop_loc_ + src_index, src.crop_bounds_[0], src.crop_bounds_[1],
-                src.crop_bounds_[2] - src.crop_bounds_[0],
-                src.crop_bounds_[3] - src.crop_bounds_[1]);
-    glUniformMatrix2fv(tex_matrix_loc_ + src_index, 1, GL_FALSE,
+    const LayerUniforms &uniforms = layer_uniforms_[src_index];
+    glUniform1f(uniforms.alpha_loc, src.alpha_);
+    glUniform1f(uniforms.premult_loc, src.premult_);
+    float crop[4];
+    GetViewportCrop(state, src, viewport_width, viewport_height, crop);
+    glUniform4fv(uniforms.crop_loc, 1, crop);
+    glUniformMatrix2fv(uniforms.tex_matrix_loc, 1, GL_FALSE,
                        src.texture_matrix_);
     glActiveTexture(GL_TEXTURE0 + src_index);
     glBindTexture(GL_TEXTURE_EXTERNAL_OES, src.handle_);
   }
 }
 
+bool GLProgram::HasSameUniforms(const RenderState &a, const RenderState &b,
+                                GLuint viewport_width,
+                                GLuint viewport_height) {
+  if (a.layer_state_.size() != b.layer_state_.size())
+    return false;
+
+  // Crops of different regions of one layer only differ by rounding.
+  static const float kMaxCropError = 1.0f / 8192;
+  for (size_t i = 0; i < a.layer_state_.size(); i++) {
+    const RenderState::LayerState &src_a = a.layer_state_[i];
+    const RenderState::LayerState &src_b = b.layer_state_[i];
+    if (src_a.handle_ != src_b.handle_ || src_a.alpha_ != src_b.alpha_ ||
+        src_a.premult_ != src_b.premult_ || src_a.swap_xy_ != src_b.swap_xy_)
+      return false;
+
+    float crop_a[4];
+    float crop_b[4];
+    GetViewportCrop(a, src_a, viewport_width, viewport_height, crop_a);
+    GetViewportCrop(b, src_b, viewport_width, viewport_height, crop_b);
+    for (int j = 0; j < 4; j++) {
+      if (std::abs(crop_a[j] - crop_b[j]) > kMaxCropError)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+void GLProgram::GetVariant(const RenderState &state,
+                           GLProgramVariant *variant) {
+  variant->clear();
+  for (const RenderState::LayerState &src : state.layer_state_) {
+    uint8_t bits = 0;
+    if (src.opaque_) {
+      bits |= kVariantOpaque;
+    } else {
+      if (src.premult_ == 0.0f)
+        bits |= kVariantCoverage;
+      if (src.alpha_ < 1.0f)
+        bits |= kVariantPlaneAlpha;
+    }
+
+    if (src.swap_xy_)
+      bits |= kVariantSwapXY;
+
+    variant->push_back(bits);
+  }
+}
+
 }  // namespace hwcomposer
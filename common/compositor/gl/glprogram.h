@@ -17,6 +17,9 @@
 #ifndef GL_PROGRAM_H_
 #define GL_PROGRAM_H_
 
+#include <stdint.h>
+
+#include <string>
 #include <vector>
 
 #include "shim.h"
@@ -25,6 +28,22 @@ namespace hwcomposer {
 
 struct RenderState;
 
+// Bits describing what a specialized program has to do for one layer.
+enum GLProgramVariantBits : uint8_t {
+  // Texture alpha is ignored, i.e. HWCBlending::kBlendingNone.
+  kVariantOpaque = 1 << 0,
+  // Texture rgb still has to be multiplied by its alpha, i.e.
+  // HWCBlending::kBlendingCoverage.
+  kVariantCoverage = 1 << 1,
+  // Plane alpha is below 1.
+  kVariantPlaneAlpha = 1 << 2,
+  // Texture coordinates have x and y swapped.
+  kVariantSwapXY = 1 << 3,
+};
+
+// One GLProgramVariantBits byte per layer, topmost layer first.
+typedef std::vector<uint8_t> GLProgramVariant;
+
 class GLProgram {
  public:
   GLProgram();
@@ -33,17 +52,39 @@ class GLProgram {
 
   ~GLProgram();
 
+  // Builds the generic program for |texture_count| layers, which handles
+  // any blending, plane alpha and transform through uniforms.
   bool Init(unsigned texture_count);
+  // Builds a program which does only what |variant| asks for, without any
+  // per pixel branches.
+  bool Init(const GLProgramVariant& variant);
   void UseProgram(const RenderState& cmd, GLuint viewport_width,
                   GLuint viewport_height);
 
+  // Sets |variant| to the variant of the program specialized for drawing
+  // |state|.
+  static void GetVariant(const RenderState& state, GLProgramVariant* variant);
+  // Returns true if |a| and |b| are drawn with the same uniforms, i.e.
+  // they are regions made of the same layers and can share a draw call.
+  static bool HasSameUniforms(const RenderState& a, const RenderState& b,
+                              GLuint viewport_width, GLuint viewport_height);
+
  private:
+  struct LayerUniforms {
+    GLint crop_loc;
+    GLint alpha_loc;
+    GLint premult_loc;
+    GLint tex_matrix_loc;
+  };
+
+  bool Link(const std::string& vertex_shader,
+            const std::string& fragment_shader);
+
   GLint program_ = 0;
-  GLint viewport_loc_;
-  GLint crop_loc_;
-  GLint alpha_loc_;
-  GLint premult_loc_;
-  GLint tex_matrix_loc_;
+  unsigned texture_count_ = 0;
+  // Specialized programs leave out the uniforms they don't need, their
+  // locations are -1 and setting them is a no-op.
+  std::vector<LayerUniforms> layer_uniforms_;
   bool initialized_;
 };
 
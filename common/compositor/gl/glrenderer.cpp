@@ -16,6 +16,8 @@
 
 #include "glrenderer.h"
 
+#include <algorithm>
+
 #include "glprogram.h"
 #include "hwctrace.h"
 #include "nativesurface.h"
@@ -25,18 +27,29 @@
 
 namespace hwcomposer {
 
+// Bounds the number of specialized programs, regions which would need
+// more keep using the generic ones.
+static const size_t kMaxProgramVariants = 64;
+
 GLRenderer::~GLRenderer() {
+  if (warm_up_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(programs_lock_);
+      stop_warm_up_ = true;
+    }
+    programs_cond_.notify_one();
+    warm_up_thread_.join();
+  }
+
+  if (vertex_buffer_)
+    glDeleteBuffers(1, &vertex_buffer_);
+
   if (vertex_array_)
     glDeleteVertexArraysOES(1, &vertex_array_);
 }
 
 bool GLRenderer::Init() {
-  // clang-format off
-  const GLfloat verts[] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f,
-                           0.0f, 2.0f, 2.0f, 0.0f, 2.0f, 0.0f};
-  // clang-format on
-
-  if (!context_.Init()) {
+  if (!context_.Init(EGL_NO_CONTEXT)) {
     ETRACE("Failed to initialize EGLContext.");
     return false;
   }
@@ -55,62 +68,120 @@ bool GLRenderer::Init() {
   glGenVertexArraysOES(1, &vertex_array);
   glBindVertexArrayOES(vertex_array);
 
+  // Filled by Draw() every frame.
   GLuint vertex_buffer;
   glGenBuffers(1, &vertex_buffer);
   glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
 
   std::unique_ptr<GLProgram> program(new GLProgram());
   if (program->Init(1)) {
     programs_.emplace_back(std::move(program));
   }
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
+  GLint max_texture_units = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_texture_units);
+  if (max_texture_units > 1)
+    warm_up_thread_ =
+        std::thread(&GLRenderer::WarmUpPrograms, this, max_texture_units);
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, NULL);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4,
-                        (void *)(sizeof(float) * 2));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, NULL);
 
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   vertex_array_ = vertex_array;
+  vertex_buffer_ = vertex_buffer;
 
   return true;
 }
 
-bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
+bool GLRenderer::Draw(const FrameVector<RenderState> &render_states,
                       NativeSurface *surface) {
   GLuint frame_width = surface->GetWidth();
   GLuint frame_height = surface->GetHeight();
   if (!surface->MakeCurrent())
     return false;
 
+  // Content outside of the damaged area is still valid from the last time
+  // this surface was rendered, so only clear what will be redrawn.
+  const HwcRect<int> &damage = surface->GetDamage();
   glViewport(0, 0, frame_width, frame_height);
-  glClear(GL_COLOR_BUFFER_BIT);
   glEnable(GL_SCISSOR_TEST);
+  glScissor(damage.left, damage.top, damage.width(), damage.height());
+  glClear(GL_COLOR_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
 
+  // Regions never overlap, so they can be drawn in any order. Regions
+  // drawn with the same program and uniforms, i.e. made of the same layers,
+  // go into one batch and are drawn as a single list of quads.
+  batches_.clear();
   for (const RenderState &state : render_states) {
-    unsigned size = state.layer_state_.size();
-    if (size == 0)
-      break;
+    if (state.layer_state_.empty())
+      continue;
 
-    GLProgram *program = GetProgram(size);
+    GLProgram *program = GetProgram(state);
     if (!program)
       continue;
 
-    program->UseProgram(state, frame_width, frame_height);
+    Batch *batch = NULL;
+    for (Batch &candidate : batches_) {
+      if (candidate.program == program &&
+          GLProgram::HasSameUniforms(*candidate.regions.front(), state,
+                                     frame_width, frame_height)) {
+        batch = &candidate;
+        break;
+      }
+    }
 
-    glScissor(state.x_, state.y_, state.width_, state.height_);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    if (!batch) {
+      batch = &batches_.emplace_back();
+      batch->program = program;
+      batch->regions.clear();
+    }
 
-    for (unsigned src_index = 0; src_index < size; src_index++) {
-      glActiveTexture(GL_TEXTURE0 + src_index);
-      glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    batch->regions.emplace_back(&state);
+  }
+
+  // Switch programs as rarely as possible.
+  std::sort(batches_.begin(), batches_.end(),
+            [](const Batch &lhs, const Batch &rhs) {
+              return lhs.program < rhs.program;
+            });
+
+  vertices_.clear();
+  for (Batch &batch : batches_) {
+    batch.first_vertex = vertices_.size() / 2;
+    for (const RenderState *state : batch.regions) {
+      GLfloat left = state->x_ / frame_width;
+      GLfloat top = state->y_ / frame_height;
+      GLfloat right = (state->x_ + state->width_) / frame_width;
+      GLfloat bottom = (state->y_ + state->height_) / frame_height;
+      // clang-format off
+      const GLfloat quad[] = {left, top, right, top, left, bottom,
+                              left, bottom, right, top, right, bottom};
+      // clang-format on
+      vertices_.insert(vertices_.end(), quad, quad + 12);
     }
   }
 
-  glDisable(GL_SCISSOR_TEST);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(GLfloat),
+               vertices_.data(), GL_STREAM_DRAW);
+
+  size_t texture_units = 0;
+  for (const Batch &batch : batches_) {
+    const RenderState &state = *batch.regions.front();
+    batch.program->UseProgram(state, frame_width, frame_height);
+    glDrawArrays(GL_TRIANGLES, batch.first_vertex, batch.regions.size() * 6);
+    texture_units = std::max(texture_units, state.layer_state_.size());
+  }
+
+  for (size_t src_index = 0; src_index < texture_units; src_index++) {
+    glActiveTexture(GL_TEXTURE0 + src_index);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
   surface->SetNativeFence(context_.GetSyncFD());
   return true;
 }
@@ -138,24 +209,110 @@ void GLRenderer::InsertFence(int kms_fence) {
 #endif
 }
 
-GLProgram *GLRenderer::GetProgram(unsigned texture_count) {
-  if (programs_.size() >= texture_count) {
-    GLProgram *program = programs_[texture_count - 1].get();
-    if (program != 0)
-      return program;
+GLProgram *GLRenderer::GetProgram(const RenderState &state) {
+  GLProgram::GetVariant(state, &variant_);
+  {
+    std::lock_guard<std::mutex> lock(programs_lock_);
+    auto it = variants_.find(variant_);
+    if (it != variants_.end()) {
+      if (it->second)
+        return it->second.get();
+    } else if (warm_up_thread_.joinable() &&
+               variants_.size() < kMaxProgramVariants) {
+      variants_.emplace(variant_, nullptr);
+      pending_variants_.emplace_back(variant_);
+      programs_cond_.notify_one();
+    }
   }
 
+  return GetGenericProgram(state.layer_state_.size());
+}
+
+GLProgram *GLRenderer::GetGenericProgram(unsigned texture_count) {
+  {
+    std::lock_guard<std::mutex> lock(programs_lock_);
+    if (programs_.size() >= texture_count) {
+      GLProgram *program = programs_[texture_count - 1].get();
+      if (program != 0)
+        return program;
+    }
+  }
+
+  // Not warmed up yet, build it here rather than wait for the warm up.
   std::unique_ptr<GLProgram> program(new GLProgram());
-  program->Init(texture_count);
-  if (program->Init(texture_count)) {
-    if (programs_.size() < texture_count)
-      programs_.resize(texture_count);
+  if (!program->Init(texture_count))
+    return 0;
+
+  return AddProgram(texture_count, std::move(program));
+}
 
+GLProgram *GLRenderer::AddProgram(unsigned texture_count,
+                                  std::unique_ptr<GLProgram> program) {
+  std::lock_guard<std::mutex> lock(programs_lock_);
+  if (programs_.size() < texture_count)
+    programs_.resize(texture_count);
+
+  if (!programs_[texture_count - 1])
     programs_[texture_count - 1] = std::move(program);
-    return programs_[texture_count - 1].get();
+
+  return programs_[texture_count - 1].get();
+}
+
+void GLRenderer::WarmUpPrograms(unsigned max_texture_count) {
+  EGLOffScreenContext context;
+  if (!context.Init(context_.GetContext()) || !context.MakeCurrent()) {
+    ETRACE("Failed to make a context for building programs.");
+    return;
+  }
+
+  for (unsigned texture_count = 2; texture_count <= max_texture_count;
+       texture_count++) {
+    if (stop_warm_up_)
+      break;
+
+    {
+      std::lock_guard<std::mutex> lock(programs_lock_);
+      if (programs_.size() >= texture_count && programs_[texture_count - 1])
+        continue;
+    }
+
+    std::unique_ptr<GLProgram> program(new GLProgram());
+    // Larger variants won't fit either.
+    if (!program->Init(texture_count))
+      break;
+
+    // The program has to be complete before the renderer context uses it.
+    glFinish();
+    AddProgram(texture_count, std::move(program));
+  }
+
+  while (true) {
+    GLProgramVariant variant;
+    {
+      std::unique_lock<std::mutex> lock(programs_lock_);
+      programs_cond_.wait(lock, [this] {
+        return stop_warm_up_ || !pending_variants_.empty();
+      });
+      if (stop_warm_up_)
+        break;
+
+      variant = std::move(pending_variants_.front());
+      pending_variants_.pop_front();
+    }
+
+    // On failure the variant stays null and the generic program is used.
+    std::unique_ptr<GLProgram> program(new GLProgram());
+    if (!program->Init(variant))
+      continue;
+
+    glFinish();
+    std::lock_guard<std::mutex> lock(programs_lock_);
+    variants_[variant] = std::move(program);
   }
 
-  return 0;
+  eglMakeCurrent(context.GetDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+  eglReleaseThread();
 }
 
 }  // namespace hwcomposer
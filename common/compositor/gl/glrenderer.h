@@ -17,7 +17,13 @@
 #ifndef GL_RENDERER_H_
 #define GL_RENDERER_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "renderer.h"
 
@@ -32,7 +38,7 @@ class GLRenderer : public Renderer {
   ~GLRenderer();
 
   bool Init() override;
-  bool Draw(const std::vector<RenderState> &commands,
+  bool Draw(const FrameVector<RenderState> &commands,
             NativeSurface *surface) override;
 
   void RestoreState() override;
@@ -42,12 +48,45 @@ class GLRenderer : public Renderer {
   void InsertFence(int kms_fence) override;
 
  private:
-  GLProgram *GetProgram(unsigned texture_count);
+  // Regions drawn with one program and one set of uniforms.
+  struct Batch {
+    GLProgram *program;
+    std::vector<const RenderState *> regions;
+    GLint first_vertex;
+  };
+
+  // Returns the program specialized for |state| once it has been built,
+  // the generic one for as many layers until then.
+  GLProgram *GetProgram(const RenderState &state);
+  GLProgram *GetGenericProgram(unsigned texture_count);
+  // Runs on warm_up_thread_ and builds the generic programs for two and
+  // more layers, then the specialized variants GetProgram() queues, on a
+  // context sharing objects with context_. Draw() never stalls on the
+  // shader compiler for them.
+  void WarmUpPrograms(unsigned max_texture_count);
+  // Adds |program| unless another thread was faster. Returns the program
+  // to use for |texture_count| layers.
+  GLProgram *AddProgram(unsigned texture_count,
+                        std::unique_ptr<GLProgram> program);
 
   EGLOffScreenContext context_;
 
   std::vector<std::unique_ptr<GLProgram>> programs_;
+  // Specialized programs, null while queued or if building failed.
+  std::map<GLProgramVariant, std::unique_ptr<GLProgram>> variants_;
+  std::deque<GLProgramVariant> pending_variants_;
+  // Protects programs_, variants_ and pending_variants_ against
+  // warm_up_thread_.
+  std::mutex programs_lock_;
+  std::condition_variable programs_cond_;
+  std::thread warm_up_thread_;
+  std::atomic<bool> stop_warm_up_{false};
   GLuint vertex_array_ = 0;
+  GLuint vertex_buffer_ = 0;
+  // Kept across frames to avoid reallocating them.
+  FrameVector<Batch> batches_;
+  std::vector<GLfloat> vertices_;
+  GLProgramVariant variant_;
 };
 
 }  // namespace hwcomposer
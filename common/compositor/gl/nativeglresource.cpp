@@ -16,6 +16,11 @@
 
 #include "nativeglresource.h"
 
+#include <inttypes.h>
+
+#include <iterator>
+
+#include "bufferimportlog.h"
 #include "hwctrace.h"
 #include "overlaybuffer.h"
 #include "overlaylayer.h"
@@ -23,50 +28,158 @@
 
 namespace hwcomposer {
 
+// Upper bound for the memory of buffers kept alive by cached textures.
+static const uint64_t kMaxCachedTextureSize = 128 * 1024 * 1024;
+
+NativeGLResource::NativeGLResource() {
+  release_log_position_ = BufferImportLog::GetInstance().GetPosition();
+}
+
 bool NativeGLResource::PrepareResources(
-    const std::vector<OverlayLayer>& layers) {
-  Reset();
-  std::vector<GLuint>().swap(layer_textures_);
+    const std::vector<OverlayLayer>& layers,
+    const std::vector<size_t>& layer_indices) {
+  // Everything handed out for the previous frame has been drawn by now.
+  DropReleasedTextures();
+  frame_++;
+  layer_textures_.assign(layers.size(), 0);
   EGLDisplay egl_display = eglGetCurrentDisplay();
-  for (auto& layer : layers) {
-    // Create EGLImage.
-    EGLImageKHR egl_image = layer.GetBuffer()->ImportImage(egl_display);
+  uint64_t hits = stats_.hits;
+  uint64_t misses = stats_.misses;
+  for (size_t layer_index : layer_indices) {
+    const OverlayLayer& layer = layers.at(layer_index);
+    OverlayBuffer* buffer = layer.GetBuffer();
+    uint64_t import_id = buffer->GetImportId();
+    auto it = lookup_.find(import_id);
+    if (import_id && it != lookup_.end()) {
+      stats_.hits++;
+      textures_.splice(textures_.begin(), textures_, it->second);
+      it->second->last_used_frame = frame_;
+      layer_textures_.at(layer_index) = it->second->texture;
+      continue;
+    }
 
-    if (egl_image == EGL_NO_IMAGE_KHR) {
-      ETRACE("Failed to make import image.");
+    stats_.misses++;
+    GLuint texture = ImportTexture(layer, egl_display);
+    if (!texture)
       return false;
+
+    layer_textures_.at(layer_index) = texture;
+    // Nothing tells when such a buffer goes away, don't keep its texture.
+    if (!import_id) {
+      frame_textures_.emplace_back(texture);
+      continue;
     }
 
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
-    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
-                                 (GLeglImageOES)egl_image);
-    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
-    layer_textures_.emplace_back(texture);
-    eglDestroyImageKHR(egl_display, egl_image);
+    CachedTexture cached;
+    cached.import_id = import_id;
+    cached.texture = texture;
+    cached.size = static_cast<uint64_t>(buffer->GetStride()) *
+                  buffer->GetHeight();
+    cached.last_used_frame = frame_;
+    textures_.emplace_front(cached);
+    lookup_[import_id] = textures_.begin();
+    cached_size_ += cached.size;
   }
 
+  EvictTextures();
+  ICOMPOSITORTRACE("Texture cache: %" PRIu64 " hits %" PRIu64
+                   " misses this frame, %" PRIu64 "/%" PRIu64
+                   " overall, %zu textures.",
+                   stats_.hits - hits, stats_.misses - misses, stats_.hits,
+                   stats_.hits + stats_.misses, textures_.size());
   return true;
 }
 
+GLuint NativeGLResource::ImportTexture(const OverlayLayer& layer,
+                                       EGLDisplay egl_display) {
+  // Create EGLImage.
+  EGLImageKHR egl_image = layer.GetBuffer()->ImportImage(egl_display);
+
+  if (egl_image == EGL_NO_IMAGE_KHR) {
+    ETRACE("Failed to make import image.");
+    return 0;
+  }
+
+  // The texture keeps the image storage alive, the image itself is not
+  // needed once it has been bound.
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
+  glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                               (GLeglImageOES)egl_image);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+  eglDestroyImageKHR(egl_display, egl_image);
+  return texture;
+}
+
+void NativeGLResource::DropReleasedTextures() {
+  if (!frame_textures_.empty()) {
+    glDeleteTextures(frame_textures_.size(), frame_textures_.data());
+    frame_textures_.clear();
+  }
+
+  released_imports_.clear();
+  if (!BufferImportLog::GetInstance().GetReleased(&release_log_position_,
+                                                  &released_imports_)) {
+    // Lost track, any of the buffers may be gone.
+    stats_.evictions += textures_.size();
+    Reset();
+    return;
+  }
+
+  for (uint64_t import_id : released_imports_) {
+    auto it = lookup_.find(import_id);
+    if (it == lookup_.end())
+      continue;
+
+    DeleteTexture(it->second);
+    stats_.evictions++;
+  }
+}
+
+void NativeGLResource::DeleteTexture(TextureList::iterator it) {
+  glDeleteTextures(1, &it->texture);
+  cached_size_ -= it->size;
+  lookup_.erase(it->import_id);
+  textures_.erase(it);
+}
+
+void NativeGLResource::EvictTextures() {
+  // Entries used this frame are at the front and never evicted, the
+  // textures handed out for it have to stay valid until it is drawn.
+  while (cached_size_ > kMaxCachedTextureSize && !textures_.empty()) {
+    auto oldest = std::prev(textures_.end());
+    if (oldest->last_used_frame == frame_)
+      break;
+
+    DeleteTexture(oldest);
+    stats_.evictions++;
+  }
+}
+
 NativeGLResource::~NativeGLResource() {
   Reset();
 }
 
 void NativeGLResource::Reset() {
-  GLuint texture_id = 0;
-  for (uint32_t i = 0; i < layer_textures_.size(); i++) {
-    texture_id = layer_textures_[i];
-    glDeleteTextures(1, &texture_id);
-  }
+  for (CachedTexture& cached : textures_)
+    glDeleteTextures(1, &cached.texture);
+
+  if (!frame_textures_.empty())
+    glDeleteTextures(frame_textures_.size(), frame_textures_.data());
+
+  frame_textures_.clear();
+  textures_.clear();
+  lookup_.clear();
+  std::vector<GLuint>().swap(layer_textures_);
+  cached_size_ = 0;
 }
 
 GpuResourceHandle NativeGLResource::GetResourceHandle(
     uint32_t layer_index) const {
-  if (layer_textures_.size() < layer_index)
+  if (layer_index >= layer_textures_.size())
     return 0;
 
   return layer_textures_.at(layer_index);
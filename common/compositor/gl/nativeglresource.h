@@ -17,6 +17,11 @@
 #ifndef NATIVE_GL_RESOURCE_H_
 #define NATIVE_GL_RESOURCE_H_
 
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+
 #include "nativegpuresource.h"
 
 #include "shim.h"
@@ -25,17 +30,60 @@ namespace hwcomposer {
 
 struct OverlayLayer;
 
+// Imports layer buffers as external textures. Textures are kept across
+// frames per buffer import, so a buffer is only imported into EGL again
+// once it has been destroyed or evicted to stay within the memory budget.
 class NativeGLResource : public NativeGpuResource {
  public:
-  NativeGLResource() = default;
+  NativeGLResource();
   ~NativeGLResource() override;
 
-  bool PrepareResources(const std::vector<OverlayLayer>& layers) override;
+  bool PrepareResources(const std::vector<OverlayLayer>& layers,
+                        const std::vector<size_t>& layer_indices) override;
   GpuResourceHandle GetResourceHandle(uint32_t layer_index) const override;
 
+  struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  const CacheStats& GetCacheStats() const {
+    return stats_;
+  }
+
  private:
+  struct CachedTexture {
+    uint64_t import_id;
+    GLuint texture;
+    // Size of the buffer kept alive by the texture.
+    uint64_t size;
+    uint64_t last_used_frame;
+  };
+
+  typedef std::list<CachedTexture> TextureList;
+
+  GLuint ImportTexture(const OverlayLayer& layer, EGLDisplay egl_display);
+  // Drops the textures of buffers which were destroyed since the last
+  // frame, and the ones imported for a single frame only.
+  void DropReleasedTextures();
+  void DeleteTexture(TextureList::iterator it);
+  // Least recently used first, drops textures over the memory budget.
+  void EvictTextures();
   void Reset();
+
+  // Most recently used first.
+  TextureList textures_;
+  std::unordered_map<uint64_t, TextureList::iterator> lookup_;
+  // Textures of buffers without an import id, only valid for one frame.
+  std::vector<GLuint> frame_textures_;
+  // Indexed by layer, 0 for layers which were not prepared.
   std::vector<GLuint> layer_textures_;
+  std::vector<uint64_t> released_imports_;
+  uint64_t release_log_position_ = 0;
+  uint64_t cached_size_ = 0;
+  uint64_t frame_ = 0;
+  CacheStats stats_;
 };
 
 }  // namespace hwcomposer
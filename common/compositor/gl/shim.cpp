@@ -45,6 +45,12 @@ bool InitializeShims() {
   get_proc(eglDupNativeFenceFDANDROID, PFNEGLDUPNATIVEFENCEFDANDROIDPROC);
 #endif
 
+  // Only used to cache linked programs, fine to be missing.
+  glGetProgramBinaryOES =
+      (PFNGLGETPROGRAMBINARYOESPROC)eglGetProcAddress("glGetProgramBinaryOES");
+  glProgramBinaryOES =
+      (PFNGLPROGRAMBINARYOESPROC)eglGetProcAddress("glProgramBinaryOES");
+
   initialized = true;
 
   return true;
@@ -59,6 +65,8 @@ PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 PFNGLDELETEVERTEXARRAYSOESPROC glDeleteVertexArraysOES;
 PFNGLGENVERTEXARRAYSOESPROC glGenVertexArraysOES;
 PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayOES;
+PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
 #ifndef USE_ANDROID_SHIM
 PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 #endif
@@ -39,6 +39,9 @@ extern PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 extern PFNGLDELETEVERTEXARRAYSOESPROC glDeleteVertexArraysOES;
 extern PFNGLGENVERTEXARRAYSOESPROC glGenVertexArraysOES;
 extern PFNGLBINDVERTEXARRAYOESPROC glBindVertexArrayOES;
+// Optional, NULL if the driver can't hand out program binaries.
+extern PFNGLGETPROGRAMBINARYOESPROC glGetProgramBinaryOES;
+extern PFNGLPROGRAMBINARYOESPROC glProgramBinaryOES;
 #ifndef USE_ANDROID_SHIM
 extern PFNEGLDUPNATIVEFENCEFDANDROIDPROC eglDupNativeFenceFDANDROID;
 #endif
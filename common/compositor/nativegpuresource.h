@@ -17,6 +17,8 @@
 #ifndef NATIVE_GPU_RESOURCE_H_
 #define NATIVE_GPU_RESOURCE_H_
 
+#include <stddef.h>
+
 #include <vector>
 
 #include "compositordefs.h"
@@ -39,7 +41,10 @@ class NativeGpuResource {
 
   NativeGpuResource& operator=(NativeGpuResource&& rhs) = delete;
 
-  virtual bool PrepareResources(const std::vector<OverlayLayer>& layers) = 0;
+  // Prepares resources for the layers at |layer_indices| only.
+  virtual bool PrepareResources(const std::vector<OverlayLayer>& layers,
+                                const std::vector<size_t>& layer_indices) = 0;
+  // Returns 0 for layers which were not prepared.
   virtual GpuResourceHandle GetResourceHandle(uint32_t layer_index) const = 0;
 };
 
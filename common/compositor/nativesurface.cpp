@@ -29,7 +29,8 @@ NativeSurface::NativeSurface(uint32_t width, uint32_t height)
       height_(height),
       ref_count_(0),
       framebuffer_format_(0),
-      in_flight_(false) {
+      in_flight_(false),
+      damage_(0, 0, width, height) {
 }
 
 NativeSurface::~NativeSurface() {
@@ -54,6 +55,7 @@ bool NativeSurface::Init(NativeBufferHandler *buffer_handler) {
   ref_count_ = 0;
   width_ = overlay_buffer_->GetWidth();
   height_ = overlay_buffer_->GetHeight();
+  damage_ = HwcRect<int>(0, 0, width_, height_);
   InitializeLayer();
 
   return true;
@@ -68,6 +70,7 @@ bool NativeSurface::InitializeForOffScreenRendering(
   InitializeLayer();
   layer_.SetSourceCrop(HwcRect<float>(0, 0, width_, height_));
   layer_.SetDisplayFrame(HwcRect<int>(0, 0, width_, height_));
+  damage_ = HwcRect<int>(0, 0, width_, height_);
 
   return true;
 }
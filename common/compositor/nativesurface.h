@@ -77,6 +77,33 @@ class NativeSurface {
 
   void ResetInFlightMode();
 
+  // Area, in the coordinates of the composition regions, which has to be
+  // cleared and redrawn in the next Draw.
+  void SetDamage(const HwcRect<int>& damage) {
+    damage_ = damage;
+  }
+
+  const HwcRect<int>& GetDamage() const {
+    return damage_;
+  }
+
+  // Frame count at which the content of this surface was last rendered and
+  // a signature of the regions it was rendered with. Together they give the
+  // buffer age of the surface. A frame of zero means the content is
+  // undefined.
+  void SetRenderedFrame(uint64_t frame, uint64_t regions_signature) {
+    rendered_frame_ = frame;
+    regions_signature_ = regions_signature;
+  }
+
+  uint64_t GetRenderedFrame() const {
+    return rendered_frame_;
+  }
+
+  uint64_t GetRegionsSignature() const {
+    return regions_signature_;
+  }
+
  protected:
   std::unique_ptr<OverlayBuffer> overlay_buffer_;
 
@@ -91,6 +118,9 @@ class NativeSurface {
   uint32_t framebuffer_format_;
   bool in_flight_;
   NativeFence fd_;
+  HwcRect<int> damage_;
+  uint64_t rendered_frame_ = 0;
+  uint64_t regions_signature_ = 0;
 };
 
 }  // namespace hwcomposer
@@ -17,7 +17,7 @@
 #ifndef RENDERER_H_
 #define RENDERER_H_
 
-#include <vector>
+#include "framevector.h"
 
 namespace hwcomposer {
 
@@ -33,7 +33,7 @@ class Renderer {
   Renderer& operator=(const Renderer& rhs) = delete;
 
   virtual bool Init() = 0;
-  virtual bool Draw(const std::vector<RenderState>& commands,
+  virtual bool Draw(const FrameVector<RenderState>& commands,
                     NativeSurface* surface) = 0;
 
   virtual void RestoreState() = 0;
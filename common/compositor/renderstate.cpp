@@ -33,6 +33,7 @@ void RenderState::ConstructState(const std::vector<OverlayLayer> &layers,
   width_ = bounds[2] - bounds[0];
   height_ = bounds[3] - bounds[1];
 
+  layer_state_.clear();
   for (size_t texture_index : region.source_layers) {
     const OverlayLayer &layer = layers.at(texture_index);
     layer_state_.emplace_back();
@@ -76,6 +77,7 @@ void RenderState::ConstructState(const std::vector<OverlayLayer> &layers,
       }
     }
 
+    src.swap_xy_ = swap_xy;
     if (swap_xy)
       std::copy_n(&TransformMatrices[4], 4, src.texture_matrix_);
     else
@@ -110,9 +112,11 @@ void RenderState::ConstructState(const std::vector<OverlayLayer> &layers,
 
     if (layer.GetBlending() == HWCBlending::kBlendingNone) {
       src.alpha_ = src.premult_ = 1.0f;
+      src.opaque_ = true;
       break;
     }
 
+    src.opaque_ = false;
     src.alpha_ = layer.GetAlpha() / 255.0f;
     src.premult_ =
         (layer.GetBlending() == HWCBlending::kBlendingPremult) ? 1.0f : 0.0f;
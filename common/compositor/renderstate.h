@@ -35,6 +35,10 @@ struct RenderState {
     float alpha_;
     float premult_;
     float texture_matrix_[4];
+    // Texture alpha is ignored, the layer hides everything below it.
+    bool opaque_;
+    // texture_matrix_ swaps x and y.
+    bool swap_xy_;
     GpuResourceHandle handle_;
   };
 
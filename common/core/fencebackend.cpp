@@ -0,0 +1,81 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "fencebackend.h"
+
+#include <memory>
+
+#include <hwctrace.h>
+
+#include "swsyncfencebackend.h"
+#include "syncobjfencebackend.h"
+#include "userfencebackend.h"
+
+namespace hwcomposer {
+
+// Release fences handed to clients are sync files, which they may merge
+// or query with the sync_file ioctls. sw_sync creates those for every
+// point, syncobj only for points already reached. kUserspace never hands
+// out sync files and is only created on request, by tests.
+static const FenceBackend::Type kPreferredTypes[] = {FenceBackend::kSwSync,
+                                                     FenceBackend::kSyncobj};
+
+FenceBackend *FenceBackend::Create(Type type, int gpu_fd) {
+  std::unique_ptr<FenceBackend> backend;
+  switch (type) {
+    case kSyncobj:
+      backend.reset(new SyncobjFenceBackend(gpu_fd));
+      break;
+    case kSwSync:
+      backend.reset(new SwSyncFenceBackend());
+      break;
+    case kUserspace:
+      backend.reset(new UserFenceBackend());
+      break;
+  }
+
+  if (!backend || !backend->Init())
+    return NULL;
+
+  return backend.release();
+}
+
+FenceBackend *FenceBackend::CreateDefault(int gpu_fd) {
+  for (Type type : kPreferredTypes) {
+    FenceBackend *backend = Create(type, gpu_fd);
+    if (backend) {
+      IDISPLAYMANAGERTRACE("Using %s fences.", GetTypeName(type));
+      return backend;
+    }
+  }
+
+  return NULL;
+}
+
+const char *FenceBackend::GetTypeName(Type type) {
+  switch (type) {
+    case kSyncobj:
+      return "syncobj";
+    case kSwSync:
+      return "sw_sync";
+    case kUserspace:
+      return "userspace";
+  }
+
+  return "unknown";
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,71 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef FENCE_BACKEND_H_
+#define FENCE_BACKEND_H_
+
+#include <stdint.h>
+
+namespace hwcomposer {
+
+// Source of the fences NativeSync hands out. A backend owns one timeline,
+// fences are created for points on it and signaled by moving the timeline
+// forward. Every fence is an fd which can be polled for POLLIN, like a
+// sync file. sw_sync fences are always real sync files which can be
+// merged or passed to the kernel, syncobj ones only for points which were
+// already signaled.
+class FenceBackend {
+ public:
+  enum Type {
+    // DRM syncobj timeline, exported as sync files or eventfds.
+    kSyncobj,
+    // sw_sync timeline, needs /dev/sw_sync or debugfs.
+    kSwSync,
+    // eventfds signaled by the process itself, always available. Only for
+    // tests, never picked by CreateDefault().
+    kUserspace
+  };
+
+  // Returns an initialized backend of |type|, or NULL if it is not
+  // supported here. |gpu_fd| is only used by kSyncobj, has to outlive
+  // the backend and may be -1.
+  static FenceBackend *Create(Type type, int gpu_fd);
+
+  // Tries sw_sync, which keeps the sync file contract, then syncobj and
+  // returns the first one which works, or NULL.
+  static FenceBackend *CreateDefault(int gpu_fd);
+
+  static const char *GetTypeName(Type type);
+
+  virtual ~FenceBackend() {
+  }
+
+  virtual Type GetType() const = 0;
+
+  // Returns an fd which becomes readable once the timeline reaches
+  // |point|, or a negative value on failure.
+  virtual int CreateFence(uint64_t point) = 0;
+
+  // Signals all points up to and including |point|. Points have to be
+  // passed in increasing order.
+  virtual bool Signal(uint64_t point) = 0;
+
+ protected:
+  virtual bool Init() = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // FENCE_BACKEND_H_
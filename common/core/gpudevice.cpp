@@ -16,6 +16,7 @@
 
 #include <gpudevice.h>
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <time.h>
 #include <fcntl.h>
@@ -35,9 +36,12 @@
 #include <linux/types.h>
 #include <linux/netlink.h>
 
+#include <chrono>
+
 #include <hwctrace.h>
 
 #include "displayplanemanager.h"
+#include "drmpropertyregistry.h"
 #include "drmscopedtypes.h"
 #include "headless.h"
 #include "hwcthread.h"
@@ -76,6 +80,7 @@ class GpuDevice::DisplayManager : public HWCThread {
   struct udev_monitor *monitor_;
 #endif
   std::unique_ptr<NativeBufferHandler> buffer_handler_;
+  std::unique_ptr<DrmPropertyRegistry> property_registry_;
   std::unique_ptr<NativeDisplay> headless_;
   std::unique_ptr<NativeDisplay> virtual_display_;
   std::vector<std::unique_ptr<NativeDisplay>> displays_;
@@ -112,6 +117,9 @@ bool GpuDevice::DisplayManager::Init(uint32_t fd) {
     return false;
   }
 
+#ifdef ENABLE_HOT_PLUG_EVENT_TRACING
+  auto start = std::chrono::steady_clock::now();
+#endif
   ScopedDrmResourcesPtr res(drmModeGetResources(fd_));
   buffer_handler_.reset(NativeBufferHandler::CreateInstance(fd_));
   if (!buffer_handler_) {
@@ -119,6 +127,10 @@ bool GpuDevice::DisplayManager::Init(uint32_t fd) {
     return false;
   }
 
+  // Shared by all displays, so each plane, CRTC and property is only
+  // queried once.
+  property_registry_.reset(new DrmPropertyRegistry(fd_));
+
   for (int32_t i = 0; i < res->count_crtcs; ++i) {
     ScopedDrmCrtcPtr c(drmModeGetCrtc(fd_, res->crtcs[i]));
     if (!c) {
@@ -127,7 +139,8 @@ bool GpuDevice::DisplayManager::Init(uint32_t fd) {
     }
 
     std::unique_ptr<NativeDisplay> display(
-        new InternalDisplay(fd_, *(buffer_handler_.get()), i, c->crtc_id));
+        new InternalDisplay(fd_, *(buffer_handler_.get()),
+                            *(property_registry_.get()), i, c->crtc_id));
     if (!display->Initialize()) {
       ETRACE("Failed to Initialize Display %d", c->crtc_id);
       return false;
@@ -143,6 +156,15 @@ bool GpuDevice::DisplayManager::Init(uint32_t fd) {
     ETRACE("Failed to connect display.");
     return false;
   }
+
+#ifdef ENABLE_HOT_PLUG_EVENT_TRACING
+  int64_t init_time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+  IHOTPLUGEVENTTRACE("Display initialization took %" PRId64 "us and %" PRIu64
+                     " property queries.",
+                     init_time_us, property_registry_->GetQueryCount());
+#endif
 #ifdef UDEV_SUPPORT
   udev_ = udev_new();
   if (udev_ == NULL) {
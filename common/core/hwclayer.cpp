@@ -42,4 +42,14 @@ void HwcLayer::SetDisplayFrame(const HwcRect<int>& display_frame) {
   display_frame_ = display_frame;
 }
 
+void HwcLayer::SetSurfaceDamage(const HwcRect<int>& surface_damage) {
+  surface_damage_ = surface_damage;
+  has_surface_damage_ = true;
+}
+
+void HwcLayer::ResetSurfaceDamage() {
+  surface_damage_ = HwcRect<int>(0, 0, 0, 0);
+  has_surface_damage_ = false;
+}
+
 }  // namespace hwcomposer
@@ -16,11 +16,18 @@
 
 #include <internaldisplay.h>
 
+#include <inttypes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
 #include <hwcdefs.h>
 #include <hwclayer.h>
 #include <hwctrace.h>
 
 #include "displayplanemanager.h"
+#include "drmpropertyregistry.h"
 #include "nativesync.h"
 #include "overlaylayer.h"
 
@@ -28,10 +35,52 @@ namespace hwcomposer {
 
 static const int32_t kUmPerInch = 25400;
 
+// Maps the surface damage of |layer| from source buffer to display
+// coordinates. Transformed layers are treated as fully damaged when they
+// changed, as are layers without damage information.
+static HwcRect<int> GetDisplayDamage(const HwcLayer *layer) {
+  const HwcRect<int> &display_frame = layer->GetDisplayFrame();
+  if (!layer->HasSurfaceDamage() || layer->GetTransform())
+    return display_frame;
+
+  const HwcRect<int> &damage = layer->GetSurfaceDamage();
+  if (damage.width() <= 0 || damage.height() <= 0)
+    return HwcRect<int>(0, 0, 0, 0);
+
+  const HwcRect<float> &source_crop = layer->GetSourceCrop();
+  float crop_width = source_crop.width();
+  float crop_height = source_crop.height();
+  if (crop_width <= 0 || crop_height <= 0)
+    return display_frame;
+
+  float scale_x = display_frame.width() / crop_width;
+  float scale_y = display_frame.height() / crop_height;
+  HwcRect<int> display_damage(
+      display_frame.left +
+          std::floor((damage.left - source_crop.left) * scale_x),
+      display_frame.top + std::floor((damage.top - source_crop.top) * scale_y),
+      display_frame.left +
+          std::ceil((damage.right - source_crop.left) * scale_x),
+      display_frame.top +
+          std::ceil((damage.bottom - source_crop.top) * scale_y));
+  display_damage.left = std::max(display_damage.left, display_frame.left);
+  display_damage.top = std::max(display_damage.top, display_frame.top);
+  display_damage.right = std::min(display_damage.right, display_frame.right);
+  display_damage.bottom =
+      std::min(display_damage.bottom, display_frame.bottom);
+  if (display_damage.left >= display_damage.right ||
+      display_damage.top >= display_damage.bottom)
+    return HwcRect<int>(0, 0, 0, 0);
+
+  return display_damage;
+}
+
 InternalDisplay::InternalDisplay(uint32_t gpu_fd,
                                  NativeBufferHandler &buffer_handler,
+                                 DrmPropertyRegistry &property_registry,
                                  uint32_t pipe_id, uint32_t crtc_id)
     : buffer_handler_(buffer_handler),
+      property_registry_(property_registry),
       crtc_id_(crtc_id),
       pipe_(pipe_id),
       connector_(0),
@@ -51,15 +100,17 @@ InternalDisplay::~InternalDisplay() {
 }
 
 bool InternalDisplay::Initialize() {
-  ScopedDrmObjectPropertyPtr crtc_props(
-      drmModeObjectGetProperties(gpu_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC));
-  GetDrmObjectProperty("ACTIVE", crtc_props, &active_prop_);
-  GetDrmObjectProperty("MODE_ID", crtc_props, &mode_id_prop_);
+  GetDrmObjectProperty("ACTIVE", crtc_id_, DRM_MODE_OBJECT_CRTC,
+                       &active_prop_);
+  GetDrmObjectProperty("MODE_ID", crtc_id_, DRM_MODE_OBJECT_CRTC,
+                       &mode_id_prop_);
 #ifndef DISABLE_EXPLICIT_SYNC
-  GetDrmObjectProperty("OUT_FENCE_PTR", crtc_props, &out_fence_ptr_prop_);
+  GetDrmObjectProperty("OUT_FENCE_PTR", crtc_id_, DRM_MODE_OBJECT_CRTC,
+                       &out_fence_ptr_prop_);
 #endif
   frame_ = 0;
   flip_handler_.reset(new PageFlipEventHandler());
+  flip_handler_->SetVBlankCallback([this]() { FlushCursorPosition(); });
 
   return true;
 }
@@ -75,6 +126,10 @@ bool InternalDisplay::Connect(const drmModeModeInfo &mode_info,
   }
   ScopedSpinLock lock(spin_lock_);
   IHOTPLUGEVENTTRACE("Display is being connected to a new connector.");
+#ifdef ENABLE_HOT_PLUG_EVENT_TRACING
+  auto start = std::chrono::steady_clock::now();
+  uint64_t queries = property_registry_.GetQueryCount();
+#endif
   mode_ = mode_info;
   connector_ = connector->connector_id;
   width_ = mode_.hdisplay;
@@ -84,31 +139,42 @@ bool InternalDisplay::Connect(const drmModeModeInfo &mode_info,
   dpiy_ =
       connector->mmHeight ? (height_ * kUmPerInch) / connector->mmHeight : -1;
 
-  ScopedDrmObjectPropertyPtr connector_props(drmModeObjectGetProperties(
-      gpu_fd_, connector_, DRM_MODE_OBJECT_CONNECTOR));
-  if (!connector_props) {
-    ETRACE("Unable to get connector properties.");
-    return false;
-  }
-
-  GetDrmObjectProperty("DPMS", connector_props, &dpms_prop_);
-  GetDrmObjectProperty("CRTC_ID", connector_props, &crtc_prop_);
+  // Connector objects can be replaced on hotplug, always look them up
+  // again.
+  property_registry_.InvalidateObject(connector_);
+  GetDrmObjectProperty("DPMS", connector_, DRM_MODE_OBJECT_CONNECTOR,
+                       &dpms_prop_);
+  GetDrmObjectProperty("CRTC_ID", connector_, DRM_MODE_OBJECT_CONNECTOR,
+                       &crtc_prop_);
   is_powered_off_ = false;
   is_connected_ = true;
   display_plane_manager_.reset(
       new DisplayPlaneManager(gpu_fd_, pipe_, crtc_id_));
 
-  if (!display_plane_manager_->Initialize(&buffer_handler_, width_, height_)) {
+  if (!display_plane_manager_->Initialize(&buffer_handler_, &property_registry_,
+                                          width_, height_)) {
     ETRACE("Failed to initialize Display Manager.");
     return false;
   }
 
+  display_plane_manager_->SetAllocationStrategy(plane_allocation_);
+
   compositor_.Init();
   flip_handler_->Init(refresh_, gpu_fd_, pipe_);
   dpms_mode_ = DRM_MODE_DPMS_ON;
   drmModeConnectorSetProperty(gpu_fd_, connector_, dpms_prop_,
                               DRM_MODE_DPMS_ON);
   pending_operations_ |= PendingModeset::kModeset;
+#ifdef ENABLE_HOT_PLUG_EVENT_TRACING
+  int64_t connect_time_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+  IHOTPLUGEVENTTRACE("Connect took %" PRId64 "us and %" PRIu64
+                     " property queries.",
+                     connect_time_us,
+                     property_registry_.GetQueryCount() - queries);
+#endif
 
   return true;
 }
@@ -144,6 +210,9 @@ void InternalDisplay::ShutDown() {
 
   display_plane_manager_->DisablePipe(pset.get());
   display_plane_manager_.reset(nullptr);
+  // Nothing is shown anymore, release every buffer.
+  if (sync_.IsInitialized())
+    sync_.SignalCompositionDone();
 }
 
 bool InternalDisplay::GetDisplayAttribute(uint32_t /*config*/,
@@ -223,11 +292,97 @@ bool InternalDisplay::SetDpmsMode(uint32_t dpms_mode) {
   dpms_mode_ = dpms_mode;
   drmModeConnectorSetProperty(gpu_fd_, connector_, dpms_prop_,
                               dpms_mode);
+  if (display_plane_manager_)
+    display_plane_manager_->InvalidateValidationCache();
+
+  return true;
+}
+
+bool InternalDisplay::SetPlaneAllocation(HWCPlaneAllocation allocation) {
+  ScopedSpinLock lock(spin_lock_);
+  plane_allocation_ = allocation;
+  if (display_plane_manager_)
+    display_plane_manager_->SetAllocationStrategy(allocation);
+
   return true;
 }
 
+bool InternalDisplay::SetCursorPosition(int32_t x, int32_t y) {
+  CTRACE();
+  ScopedSpinLock lock(spin_lock_);
+  if (is_powered_off_ || !display_plane_manager_ ||
+      (pending_operations_ & kModeset))
+    return false;
+
+  cursor_x_ = x;
+  cursor_y_ = y;
+  // The scheduled update picks up the new position.
+  if (cursor_update_scheduled_)
+    return true;
+
+  // Moves arriving faster than the display refreshes, or while the last
+  // commit is still pending, wait for the next vblank.
+  auto now = std::chrono::steady_clock::now();
+  if (refresh_ > 0 &&
+      now - last_cursor_update_ <
+          std::chrono::duration<float>(1.0f / refresh_)) {
+    ScheduleCursorUpdate();
+    return true;
+  }
+
+  int ret = display_plane_manager_->UpdateCursorPosition(x, y);
+  if (ret == -EBUSY) {
+    ScheduleCursorUpdate();
+    return true;
+  }
+
+  if (ret)
+    return false;
+
+  last_cursor_update_ = now;
+  return true;
+}
+
+void InternalDisplay::ScheduleCursorUpdate() {
+  cursor_update_scheduled_ = true;
+  flip_handler_->RequestVBlankCallback();
+}
+
+void InternalDisplay::FlushCursorPosition() {
+  // Runs on the vblank thread, which must not stall behind Present. Try
+  // again on the next vblank while a frame is being presented.
+  if (!spin_lock_.try_lock()) {
+    flip_handler_->RequestVBlankCallback();
+    return;
+  }
+
+  std::lock_guard<SpinLock> lock(spin_lock_, std::adopt_lock);
+  if (!cursor_update_scheduled_)
+    return;
+
+  cursor_update_scheduled_ = false;
+  // Nothing to move while the pipe is off or waiting for a modeset, whose
+  // Present places the cursor.
+  if (is_powered_off_ || !display_plane_manager_ ||
+      (pending_operations_ & kModeset))
+    return;
+
+  int ret = display_plane_manager_->UpdateCursorPosition(cursor_x_, cursor_y_);
+  if (ret == -EBUSY) {
+    ScheduleCursorUpdate();
+    return;
+  }
+
+  if (ret) {
+    IDISPLAYMANAGERTRACE("Failed to move the cursor after vblank.");
+    return;
+  }
+
+  last_cursor_update_ = std::chrono::steady_clock::now();
+}
+
 bool InternalDisplay::ApplyPendingModeset(drmModeAtomicReqPtr property_set,
-                                          NativeSync *sync,
+                                          int64_t sync_point,
                                           uint64_t *out_fence) {
   if (pending_operations_ & kModeset) {
     if (old_blob_id_) {
@@ -267,26 +422,21 @@ bool InternalDisplay::ApplyPendingModeset(drmModeAtomicReqPtr property_set,
       }
     }
 #else
-    *out_fence = sync->CreateNextTimelineFence();
+    *out_fence = sync_.CreateTimelineFence(sync_point);
 #endif
   }
 
   return true;
 }
 
-void InternalDisplay::GetDrmObjectProperty(
-    const char *name, const ScopedDrmObjectPropertyPtr &props,
-    uint32_t *id) const {
-  uint32_t count_props = props->count_props;
-  for (uint32_t i = 0; i < count_props; i++) {
-    ScopedDrmPropertyPtr property(drmModeGetProperty(gpu_fd_, props->props[i]));
-    if (property && !strcmp(property->name, name)) {
-      *id = property->prop_id;
-      break;
-    }
-  }
-  if (!(*id))
+void InternalDisplay::GetDrmObjectProperty(const char *name,
+                                           uint32_t object_id,
+                                           uint32_t object_type,
+                                           uint32_t *id) const {
+  if (!property_registry_.GetPropertyId(object_id, object_type, name, id)) {
+    *id = 0;
     ETRACE("Could not find property %s", name);
+  }
 }
 
 bool InternalDisplay::Present(
@@ -299,45 +449,39 @@ bool InternalDisplay::Present(
   }
 
   bool needs_modeset = pending_operations_ & kModeset;
-  // Create a Sync object for this Composition.
-  std::unique_ptr<NativeSync> sync_object(new NativeSync());
-  if (!sync_object->Init()) {
-    ETRACE("Failed to create sync object.");
+  // The timeline is created once and lives as long as the display.
+  if (!sync_.IsInitialized() && !sync_.Init(gpu_fd_)) {
+    ETRACE("Failed to create sync timeline.");
     return false;
   }
 
-  std::vector<OverlayLayer> layers;
-  std::vector<HwcRect<int>> layers_rects;
-
   int ret = 0;
   size_t size = source_layers.size();
+  layers_.resize(size);
+  layers_rects_.resize(size);
   for (size_t layer_index = 0; layer_index < size; layer_index++) {
     HwcLayer *layer = source_layers.at(layer_index);
-    layers.emplace_back();
-    OverlayLayer &overlay_layer = layers.back();
-    overlay_layer.SetNativeHandle(layer->GetNativeHandle());
-    overlay_layer.SetTransform(layer->GetTransform());
-    overlay_layer.SetAlpha(layer->GetAlpha());
-    overlay_layer.SetBlending(layer->GetBlending());
-    overlay_layer.SetSourceCrop(layer->GetSourceCrop());
-    overlay_layer.SetDisplayFrame(layer->GetDisplayFrame());
+    OverlayLayer &overlay_layer = layers_.at(layer_index);
+    overlay_layer.UpdateFrom(*layer);
+    overlay_layer.SetSurfaceDamage(GetDisplayDamage(layer));
+    layer->ResetSurfaceDamage();
     overlay_layer.SetIndex(layer_index);
     overlay_layer.SetAcquireFence(layer->acquire_fence.Release());
     overlay_layer.SetReleaseFence(layer->release_fence.Release());
-    layers_rects.emplace_back(layer->GetDisplayFrame());
+    layers_rects_.at(layer_index) = layer->GetDisplayFrame();
   }
 
+  compositor_.UpdateDamage(layers_);
+
   // Reset any Display Manager and Compositor state.
-  if (!display_plane_manager_->BeginFrameUpdate(layers)) {
+  if (!display_plane_manager_->BeginFrameUpdate(layers_)) {
     ETRACE("Failed to import needed buffers in DisplayManager.");
     return false;
   }
 
-  DisplayPlaneStateList current_composition_planes;
-  bool render_layers;
   // Validate Overlays and Layers usage.
-  std::tie(render_layers, current_composition_planes) =
-      display_plane_manager_->ValidateLayers(layers, needs_modeset);
+  bool render_layers = display_plane_manager_->ValidateLayers(
+      layers_, needs_modeset, composition_planes_);
 
   DUMP_CURRENT_COMPOSITION_PLANES();
 
@@ -348,42 +492,55 @@ bool InternalDisplay::Present(
 
   if (render_layers) {
     // Prepare for final composition.
-    if (!compositor_.Draw(current_composition_planes, layers, layers_rects)) {
+    if (!compositor_.Draw(composition_planes_, layers_,
+                          layers_rects_)) {
       ETRACE("Failed to prepare for the frame composition ret=%d", ret);
       return false;
     }
   }
 
-  // Do the actual commit.
-  ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
+  // Do the actual commit. The property set is kept across frames and only
+  // rolled back.
+  if (!pset_)
+    pset_.reset(drmModeAtomicAlloc());
+  else
+    drmModeAtomicSetCursor(pset_.get(), 0);
 
-  if (!pset) {
+  if (!pset_) {
     ETRACE("Failed to allocate property set %d", -ENOMEM);
     return false;
   }
 
+  drmModeAtomicReqPtr pset = pset_.get();
+
+  // All layers of a frame are released together, at one timeline point.
+  int64_t sync_point = sync_.ReserveTimelinePoint();
   for (size_t layer_index = 0; layer_index < size; layer_index++) {
     HwcLayer *layer = source_layers.at(layer_index);
-    int ret =
-        layer->release_fence.Reset(sync_object->CreateNextTimelineFence());
+    int ret = layer->release_fence.Reset(sync_.CreateTimelineFence(sync_point));
     if (ret < 0)
       ETRACE("Failed to create fence for layer, error: %s", PRINTERROR());
   }
 
   uint64_t fence = 0;
-  if (!ApplyPendingModeset(pset.get(), sync_object.get(), &fence)) {
+  if (!ApplyPendingModeset(pset, sync_point, &fence)) {
     ETRACE("Failed to Modeset");
     return false;
   }
 
   bool succesful_commit = true;
 
-  if (!display_plane_manager_->CommitFrame(current_composition_planes,
-                                           pset.get(), needs_modeset,
-                                           sync_object, out_fence_)) {
+  if (!display_plane_manager_->CommitFrame(composition_planes_,
+                                           pset, needs_modeset, &sync_,
+                                           out_fence_)) {
     succesful_commit = false;
   } else {
     display_plane_manager_->EndFrameUpdate();
+    // The previous frame is off screen once this one has been committed.
+    if (!needs_modeset) {
+      sync_.IncreaseTimelineToPoint(displayed_sync_point_);
+      displayed_sync_point_ = sync_point;
+    }
   }
 
   if (!succesful_commit || needs_modeset) {
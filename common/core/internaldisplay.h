@@ -19,6 +19,7 @@
 
 #include "platformdefines.h"
 
+#include <chrono>
 #include <mutex>
 #include <stdint.h>
 #include <xf86drmMode.h>
@@ -28,6 +29,8 @@
 #include <nativebufferhandler.h>
 
 #include "compositor.h"
+#include "nativesync.h"
+#include "overlaylayer.h"
 #include "pageflipeventhandler.h"
 #include "scopedfd.h"
 #include "spinlock.h"
@@ -35,13 +38,15 @@
 namespace hwcomposer {
 class DisplayPlaneState;
 class DisplayPlaneManager;
+class DrmPropertyRegistry;
 class GpuDevice;
 struct HwcLayer;
 
 class InternalDisplay : public NativeDisplay {
  public:
   InternalDisplay(uint32_t gpu_fd, NativeBufferHandler &handler,
-                  uint32_t pipe_id, uint32_t crtc_id);
+                  DrmPropertyRegistry &property_registry, uint32_t pipe_id,
+                  uint32_t crtc_id);
   ~InternalDisplay();
 
   bool Initialize() override;
@@ -76,6 +81,10 @@ class InternalDisplay : public NativeDisplay {
 
   bool SetDpmsMode(uint32_t dpms_mode) override;
 
+  bool SetPlaneAllocation(HWCPlaneAllocation allocation) override;
+
+  bool SetCursorPosition(int32_t x, int32_t y) override;
+
   bool Present(std::vector<hwcomposer::HwcLayer *> &source_layers) override;
 
   int RegisterVsyncCallback(std::shared_ptr<VsyncCallback> callback,
@@ -104,14 +113,18 @@ class InternalDisplay : public NativeDisplay {
 
   void ShutDownPipe();
   void InitializeResources();
-  bool ApplyPendingModeset(drmModeAtomicReqPtr property_set, NativeSync *sync,
-                           uint64_t *out_fence);
+  bool ApplyPendingModeset(drmModeAtomicReqPtr property_set,
+                           int64_t sync_point, uint64_t *out_fence);
+  // Has the latest cursor position committed after the next vblank.
+  void ScheduleCursorUpdate();
+  // Runs on the page flip event thread.
+  void FlushCursorPosition();
 
-  void GetDrmObjectProperty(const char *name,
-                            const ScopedDrmObjectPropertyPtr &props,
-                            uint32_t *id) const;
+  void GetDrmObjectProperty(const char *name, uint32_t object_id,
+                            uint32_t object_type, uint32_t *id) const;
 
   NativeBufferHandler &buffer_handler_;
+  DrmPropertyRegistry &property_registry_;
   Compositor compositor_;
   drmModeModeInfo mode_;
   uint32_t frame_;
@@ -123,6 +136,7 @@ class InternalDisplay : public NativeDisplay {
   uint32_t crtc_id_;
   uint32_t pipe_;
   uint32_t dpms_mode_ = DRM_MODE_DPMS_ON;
+  HWCPlaneAllocation plane_allocation_ = HWCPlaneAllocation::kGreedy;
   uint32_t connector_;
   uint32_t pending_operations_ = kNone;
   uint32_t blob_id_ = 0;
@@ -136,6 +150,25 @@ class InternalDisplay : public NativeDisplay {
   bool is_powered_off_;
   float refresh_;
   ScopedFd out_fence_ = -1;
+  // Atomic request for Present, rolled back instead of reallocated.
+  ScopedDrmAtomicReqPtr pset_;
+  // Release fences of all frames are points on this timeline. A frame's
+  // point is signaled once the next frame was committed, which can only
+  // happen after the frame's own flip completed.
+  NativeSync sync_;
+  int64_t displayed_sync_point_ = 0;
+  // Layers of the last Present, updated in place by the next one.
+  std::vector<OverlayLayer> layers_;
+  std::vector<HwcRect<int>> layers_rects_;
+  // Planes of the last Present, reused by the next one.
+  DisplayPlaneStateList composition_planes_;
+  // Time of the last cursor only commit, used to limit them to one per
+  // vblank. Moves in between are coalesced, only the latest position is
+  // committed once the vblank passed.
+  std::chrono::steady_clock::time_point last_cursor_update_;
+  int32_t cursor_x_ = 0;
+  int32_t cursor_y_ = 0;
+  bool cursor_update_scheduled_ = false;
   std::unique_ptr<PageFlipEventHandler> flip_handler_;
   std::unique_ptr<DisplayPlaneManager> display_plane_manager_;
   SpinLock spin_lock_;
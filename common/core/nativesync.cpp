@@ -16,53 +16,35 @@
 
 #include "nativesync.h"
 
-#include <string.h>
-#include <fcntl.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-
-#ifdef USE_ANDROID_SYNC
-#include <linux/sync.h>
-#include <linux/sw_sync.h>
-#else
-#include <linux/sync_file.h>
-#endif
-
 #include <libsync.h>
 
 #include <hwctrace.h>
 
 namespace hwcomposer {
 
-struct sw_sync_create_fence_data {
-  __u32 value;
-  char name[32];
-  __s32 fence; /* fd of new fence */
-};
-
-#define SW_SYNC_IOC_MAGIC 'W'
-
-#define SW_SYNC_IOC_CREATE_FENCE \
-  _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
-
-#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, __u32)
-
 NativeSync::NativeSync() {
 }
 
 NativeSync::~NativeSync() {
-  if (timeline_fd_.get() >= 0)
+  if (backend_)
     SignalCompositionDone();
 }
 
-bool NativeSync::Init() {
-#ifdef USE_ANDROID_SYNC
-  timeline_fd_.Reset(open("/dev/sw_sync", O_RDWR));
-#else
-  timeline_fd_.Reset(open("/sys/kernel/debug/sync/sw_sync", O_RDWR));
-#endif
-  if (timeline_fd_.get() < 0) {
-    ETRACE("Failed to create sw sync timeline %s", PRINTERROR());
+bool NativeSync::Init(int gpu_fd) {
+  backend_.reset(FenceBackend::CreateDefault(gpu_fd));
+  if (!backend_) {
+    ETRACE("Failed to create a fence timeline.");
+    return false;
+  }
+
+  return true;
+}
+
+bool NativeSync::Init(FenceBackend::Type type, int gpu_fd) {
+  backend_.reset(FenceBackend::Create(type, gpu_fd));
+  if (!backend_) {
+    ETRACE("Failed to create a %s fence timeline.",
+           FenceBackend::GetTypeName(type));
     return false;
   }
 
@@ -70,8 +52,11 @@ bool NativeSync::Init() {
 }
 
 int NativeSync::CreateNextTimelineFence() {
-  ++timeline_;
-  return sw_sync_fence_create(timeline_fd_.get(), "NativeSync", timeline_);
+  return CreateTimelineFence(ReserveTimelinePoint());
+}
+
+int NativeSync::CreateTimelineFence(int64_t point) {
+  return backend_->CreateFence(point);
 }
 
 bool NativeSync::Wait(int fence) {
@@ -84,37 +69,15 @@ bool NativeSync::Wait(int fence) {
   return true;
 }
 
-int NativeSync::IncreaseTimelineToPoint(int point) {
-  int timeline_increase = point - timeline_current_;
-  if (timeline_increase <= 0)
+int NativeSync::IncreaseTimelineToPoint(int64_t point) {
+  if (point <= timeline_current_)
     return 0;
 
-  int ret = sw_sync_timeline_inc(timeline_fd_.get(), timeline_increase);
-  if (ret)
-    ETRACE("Failed to increment sync timeline %s", PRINTERROR());
-  else
-    timeline_current_ = point;
-
-  return ret;
-}
-
-int NativeSync::sw_sync_fence_create(int fd, const char *name, unsigned value) {
-  struct sw_sync_create_fence_data data;
-  int err;
-
-  data.value = value;
-  strncpy(data.name, name, sizeof(data.name));
-  data.fence = 0;
-
-  err = ioctl(fd, SW_SYNC_IOC_CREATE_FENCE, &data);
-  if (err < 0)
-    return err;
+  if (!backend_->Signal(point))
+    return -1;
 
-  return data.fence;
+  timeline_current_ = point;
+  return 0;
 }
 
-int NativeSync::sw_sync_timeline_inc(int fd, unsigned count) {
-  uint32_t arg = count;
-  return ioctl(fd, SW_SYNC_IOC_INC, &arg);
-}
-}
+}  // namespace hwcomposer
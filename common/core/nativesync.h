@@ -19,7 +19,9 @@
 
 #include <stdint.h>
 
-#include <scopedfd.h>
+#include <memory>
+
+#include "fencebackend.h"
 
 namespace hwcomposer {
 
@@ -28,26 +30,45 @@ class NativeSync {
   NativeSync();
   virtual ~NativeSync();
 
-  bool Init();
+  // Uses the first fence backend which works on this system, see
+  // FenceBackend::CreateDefault(). |gpu_fd| may be -1.
+  bool Init(int gpu_fd);
+
+  // Only tries |type|.
+  bool Init(FenceBackend::Type type, int gpu_fd);
+
+  bool IsInitialized() const {
+    return backend_ != NULL;
+  }
 
+  FenceBackend::Type GetBackendType() const {
+    return backend_->GetType();
+  }
+
+  // Reserves the next point on the timeline and returns a fence for it.
   int CreateNextTimelineFence();
 
+  // Reserves the next point on the timeline, fences for it are created
+  // with CreateTimelineFence().
+  int64_t ReserveTimelinePoint() {
+    return ++timeline_;
+  }
+
+  // Returns a fence which signals once the timeline reaches |point|.
+  int CreateTimelineFence(int64_t point);
+
+  // Signals every fence up to and including |point|.
+  int IncreaseTimelineToPoint(int64_t point);
+
   int SignalCompositionDone() {
     return IncreaseTimelineToPoint(timeline_);
   }
 
+  // Waits for |fence|, which may come from any backend or the kernel.
   bool Wait(int fence);
 
-  int GetFd() const {
-    return timeline_fd_.get();
-  }
-
  private:
-  int IncreaseTimelineToPoint(int point);
-  int sw_sync_fence_create(int fd, const char *name, unsigned value);
-  int sw_sync_timeline_inc(int fd, unsigned count);
-
-  ScopedFd timeline_fd_;
+  std::unique_ptr<FenceBackend> backend_;
   int64_t timeline_ = 0;
   int64_t timeline_current_ = 0;
 };
@@ -16,12 +16,29 @@
 
 #include "overlaylayer.h"
 
+#include <hwclayer.h>
 #include <hwctrace.h>
 
 #include "overlaybuffer.h"
 
 namespace hwcomposer {
 
+void OverlayLayer::UpdateFrom(const HwcLayer& layer) {
+  bool all = !has_state_;
+  has_state_ = true;
+  sf_handle_ = layer.GetNativeHandle();
+  alpha_ = layer.GetAlpha();
+  blending_ = layer.GetBlending();
+  if (all || transform_ != layer.GetTransform())
+    SetTransform(layer.GetTransform());
+
+  if (all || !(source_crop_ == layer.GetSourceCrop()))
+    SetSourceCrop(layer.GetSourceCrop());
+
+  if (all || !(display_frame_ == layer.GetDisplayFrame()))
+    SetDisplayFrame(layer.GetDisplayFrame());
+}
+
 void OverlayLayer::SetIndex(uint32_t index) {
   index_ = index;
 }
@@ -26,8 +26,14 @@ namespace hwcomposer {
 
 class NativeBufferHandler;
 class OverlayBuffer;
+struct HwcLayer;
 
 struct OverlayLayer {
+  // Takes over the state of |layer|, only recomputing what changed since
+  // the last call. Fences, surface damage and the index are per frame and
+  // left to the caller.
+  void UpdateFrom(const HwcLayer& layer);
+
   void SetReleaseFence(int fd) {
     release_fence_.Reset(fd);
   }
@@ -96,6 +102,16 @@ struct OverlayLayer {
     return display_frame_;
   }
 
+  // Part of the display frame, in display coordinates, whose content changed
+  // since the previous frame. Empty if the layer content is unchanged.
+  void SetSurfaceDamage(const HwcRect<int>& surface_damage) {
+    surface_damage_ = surface_damage;
+  }
+
+  const HwcRect<int>& GetSurfaceDamage() const {
+    return surface_damage_;
+  }
+
   uint32_t GetSourceCropWidth() const {
     return source_crop_width_;
   }
@@ -122,11 +138,14 @@ struct OverlayLayer {
   uint8_t alpha_ = 0xff;
   HwcRect<float> source_crop_;
   HwcRect<int> display_frame_;
+  HwcRect<int> surface_damage_ = HwcRect<int>(0, 0, 0, 0);
   NativeFence release_fence_;
   ScopedFd acquire_fence_;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   HWCNativeHandle sf_handle_ = 0;
   OverlayBuffer* buffer_ = NULL;
+  // False until UpdateFrom() set everything once.
+  bool has_state_ = false;
 };
 
 }  // namespace hardware
@@ -0,0 +1,91 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "swsyncfencebackend.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef USE_ANDROID_SYNC
+#include <linux/sync.h>
+#include <linux/sw_sync.h>
+#else
+#include <linux/sync_file.h>
+#endif
+
+#include <hwctrace.h>
+
+namespace hwcomposer {
+
+struct sw_sync_create_fence_data {
+  __u32 value;
+  char name[32];
+  __s32 fence; /* fd of new fence */
+};
+
+#define SW_SYNC_IOC_MAGIC 'W'
+
+#define SW_SYNC_IOC_CREATE_FENCE \
+  _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
+
+#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, __u32)
+
+bool SwSyncFenceBackend::Init() {
+#ifdef USE_ANDROID_SYNC
+  timeline_fd_.Reset(open("/dev/sw_sync", O_RDWR));
+#else
+  timeline_fd_.Reset(open("/sys/kernel/debug/sync/sw_sync", O_RDWR));
+#endif
+  if (timeline_fd_.get() < 0) {
+    ETRACE("Failed to create sw sync timeline %s", PRINTERROR());
+    return false;
+  }
+
+  return true;
+}
+
+int SwSyncFenceBackend::CreateFence(uint64_t point) {
+  struct sw_sync_create_fence_data data;
+  data.value = point;
+  strncpy(data.name, "NativeSync", sizeof(data.name));
+  data.fence = 0;
+
+  int err = ioctl(timeline_fd_.get(), SW_SYNC_IOC_CREATE_FENCE, &data);
+  if (err < 0)
+    return err;
+
+  return data.fence;
+}
+
+bool SwSyncFenceBackend::Signal(uint64_t point) {
+  if (point <= signaled_point_)
+    return true;
+
+  // The timeline only counts up from where it is, in 32 bit steps.
+  uint32_t increase = point - signaled_point_;
+  if (ioctl(timeline_fd_.get(), SW_SYNC_IOC_INC, &increase)) {
+    ETRACE("Failed to increment sync timeline %s", PRINTERROR());
+    return false;
+  }
+
+  signaled_point_ = point;
+  return true;
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,46 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef SW_SYNC_FENCE_BACKEND_H_
+#define SW_SYNC_FENCE_BACKEND_H_
+
+#include <scopedfd.h>
+
+#include "fencebackend.h"
+
+namespace hwcomposer {
+
+class SwSyncFenceBackend : public FenceBackend {
+ public:
+  SwSyncFenceBackend() = default;
+
+  Type GetType() const override {
+    return kSwSync;
+  }
+
+  int CreateFence(uint64_t point) override;
+  bool Signal(uint64_t point) override;
+
+ protected:
+  bool Init() override;
+
+ private:
+  ScopedFd timeline_fd_;
+  uint64_t signaled_point_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // SW_SYNC_FENCE_BACKEND_H_
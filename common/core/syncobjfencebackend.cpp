@@ -0,0 +1,155 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "syncobjfencebackend.h"
+
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+
+#include <hwctrace.h>
+
+#ifndef DRM_CAP_SYNCOBJ_TIMELINE
+#define DRM_CAP_SYNCOBJ_TIMELINE 0x14
+#endif
+
+#ifndef DRM_SYNCOBJ_CREATE_SIGNALED
+#define DRM_SYNCOBJ_CREATE_SIGNALED (1 << 0)
+#endif
+
+namespace hwcomposer {
+
+// Not in older libdrm headers.
+struct hwc_syncobj_eventfd {
+  __u32 handle;
+  __u32 flags;
+  __u64 point;
+  __s32 fd;
+  __u32 pad;
+};
+
+#define HWC_IOCTL_SYNCOBJ_EVENTFD DRM_IOWR(0xCF, struct hwc_syncobj_eventfd)
+
+SyncobjFenceBackend::SyncobjFenceBackend(int gpu_fd) : gpu_fd_(gpu_fd) {
+}
+
+SyncobjFenceBackend::~SyncobjFenceBackend() {
+  if (handle_)
+    drmSyncobjDestroy(gpu_fd_, handle_);
+
+  if (binary_handle_)
+    drmSyncobjDestroy(gpu_fd_, binary_handle_);
+}
+
+bool SyncobjFenceBackend::Init() {
+  if (gpu_fd_ < 0)
+    return false;
+
+  uint64_t timeline = 0;
+  if (drmGetCap(gpu_fd_, DRM_CAP_SYNCOBJ_TIMELINE, &timeline) || !timeline)
+    return false;
+
+  if (drmSyncobjCreate(gpu_fd_, 0, &handle_)) {
+    ETRACE("Failed to create syncobj %s", PRINTERROR());
+    handle_ = 0;
+    return false;
+  }
+
+  // Created signaled, so exporting it below checks for sync file export
+  // without touching the timeline.
+  if (drmSyncobjCreate(gpu_fd_, DRM_SYNCOBJ_CREATE_SIGNALED,
+                       &binary_handle_)) {
+    ETRACE("Failed to create syncobj %s", PRINTERROR());
+    binary_handle_ = 0;
+    return false;
+  }
+
+  int fence = -1;
+  if (drmSyncobjExportSyncFile(gpu_fd_, binary_handle_, &fence))
+    return false;
+
+  close(fence);
+
+  // Older kernels have timelines but can't signal eventfds from them.
+  fence = CreateEventFence(1);
+  if (fence < 0)
+    return false;
+
+  close(fence);
+  return true;
+}
+
+int SyncobjFenceBackend::CreateFence(uint64_t point) {
+  if (point > signaled_point_)
+    return CreateEventFence(point);
+
+  // DRM_IOCTL_SYNCOBJ_TRANSFER moves the fence of |point| into the binary
+  // syncobj, DRM_IOCTL_SYNCOBJ_HANDLE_TO_FD with
+  // DRM_SYNCOBJ_HANDLE_TO_FD_FLAGS_EXPORT_SYNC_FILE turns that into a
+  // sync file. The binary syncobj is overwritten by the next transfer,
+  // the sync file keeps its own reference to the fence.
+  if (drmSyncobjTransfer(gpu_fd_, binary_handle_, 0, handle_, point, 0)) {
+    int ret = -errno;
+    ETRACE("Failed to transfer syncobj point %s", PRINTERROR());
+    return ret;
+  }
+
+  int fd = -1;
+  if (drmSyncobjExportSyncFile(gpu_fd_, binary_handle_, &fd)) {
+    int ret = -errno;
+    ETRACE("Failed to export sync file %s", PRINTERROR());
+    return ret;
+  }
+
+  return fd;
+}
+
+int SyncobjFenceBackend::CreateEventFence(uint64_t point) {
+  int fd = eventfd(0, EFD_CLOEXEC);
+  if (fd < 0)
+    return fd;
+
+  struct hwc_syncobj_eventfd args = {};
+  args.handle = handle_;
+  args.point = point;
+  args.fd = fd;
+  if (drmIoctl(gpu_fd_, HWC_IOCTL_SYNCOBJ_EVENTFD, &args)) {
+    int ret = -errno;
+    close(fd);
+    return ret;
+  }
+
+  return fd;
+}
+
+bool SyncobjFenceBackend::Signal(uint64_t point) {
+  if (point <= signaled_point_)
+    return true;
+
+  // A host signal at |point| also completes every earlier point which
+  // never got a fence of its own.
+  if (drmSyncobjTimelineSignal(gpu_fd_, &handle_, &point, 1)) {
+    ETRACE("Failed to signal syncobj timeline %s", PRINTERROR());
+    return false;
+  }
+
+  signaled_point_ = point;
+  return true;
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,56 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef SYNCOBJ_FENCE_BACKEND_H_
+#define SYNCOBJ_FENCE_BACKEND_H_
+
+#include "fencebackend.h"
+
+namespace hwcomposer {
+
+// Timeline syncobj on the DRM device, signaled from the CPU, so no sw_sync
+// access is needed. Fences for points already reached are sync files,
+// exported through a binary syncobj. The kernel only has a fence for a
+// point once it has been signaled, fences for later points are eventfds
+// it signals once the point is reached. Needs DRM_CAP_SYNCOBJ_TIMELINE
+// and DRM_IOCTL_SYNCOBJ_EVENTFD (Linux 6.6).
+class SyncobjFenceBackend : public FenceBackend {
+ public:
+  explicit SyncobjFenceBackend(int gpu_fd);
+  ~SyncobjFenceBackend() override;
+
+  Type GetType() const override {
+    return kSyncobj;
+  }
+
+  int CreateFence(uint64_t point) override;
+  bool Signal(uint64_t point) override;
+
+ protected:
+  bool Init() override;
+
+ private:
+  int CreateEventFence(uint64_t point);
+
+  int gpu_fd_;
+  uint32_t handle_ = 0;
+  // Sync files are exported from here.
+  uint32_t binary_handle_ = 0;
+  uint64_t signaled_point_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // SYNCOBJ_FENCE_BACKEND_H_
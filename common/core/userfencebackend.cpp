@@ -0,0 +1,72 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "userfencebackend.h"
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <hwctrace.h>
+
+namespace hwcomposer {
+
+bool UserFenceBackend::Init() {
+  return true;
+}
+
+int UserFenceBackend::CreateFence(uint64_t point) {
+  if (point <= signaled_point_)
+    return eventfd(1, EFD_CLOEXEC);
+
+  // Points are mostly created in increasing order, look from the back.
+  auto it = pending_.end();
+  while (it != pending_.begin() && (it - 1)->first >= point)
+    --it;
+
+  if (it == pending_.end() || it->first != point) {
+    int fd = eventfd(0, EFD_CLOEXEC);
+    if (fd < 0) {
+      ETRACE("Failed to create eventfd %s", PRINTERROR());
+      return fd;
+    }
+
+    it = pending_.emplace(it, point, ScopedFd(fd));
+  }
+
+  return fcntl(it->second.get(), F_DUPFD_CLOEXEC, 0);
+}
+
+bool UserFenceBackend::Signal(uint64_t point) {
+  bool succeeded = true;
+  while (!pending_.empty() && pending_.front().first <= point) {
+    uint64_t value = 1;
+    if (write(pending_.front().second.get(), &value, sizeof(value)) !=
+        sizeof(value)) {
+      ETRACE("Failed to signal eventfd %s", PRINTERROR());
+      succeeded = false;
+    }
+
+    pending_.pop_front();
+  }
+
+  if (point > signaled_point_)
+    signaled_point_ = point;
+
+  return succeeded;
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,54 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef USER_FENCE_BACKEND_H_
+#define USER_FENCE_BACKEND_H_
+
+#include <deque>
+#include <utility>
+
+#include <scopedfd.h>
+
+#include "fencebackend.h"
+
+namespace hwcomposer {
+
+// Timeline kept entirely in the process. Each pending point has one
+// eventfd, fences are duplicates of it and become readable once the point
+// is signaled. Needs no kernel support beyond eventfd, which makes it
+// usable in tests and as a last resort.
+class UserFenceBackend : public FenceBackend {
+ public:
+  UserFenceBackend() = default;
+
+  Type GetType() const override {
+    return kUserspace;
+  }
+
+  int CreateFence(uint64_t point) override;
+  bool Signal(uint64_t point) override;
+
+ protected:
+  bool Init() override;
+
+ private:
+  // Pending points with their eventfd, in increasing order.
+  std::deque<std::pair<uint64_t, ScopedFd>> pending_;
+  uint64_t signaled_point_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // USER_FENCE_BACKEND_H_
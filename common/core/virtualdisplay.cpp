@@ -70,6 +70,8 @@ bool VirtualDisplay::Present(
     overlay_layer.SetBlending(layer->GetBlending());
     overlay_layer.SetSourceCrop(layer->GetSourceCrop());
     overlay_layer.SetDisplayFrame(layer->GetDisplayFrame());
+    // The output buffer is fully redrawn every frame.
+    layer->ResetSurfaceDamage();
     overlay_layer.SetIndex(layer_index);
     overlay_layer.SetAcquireFence(layer->acquire_fence.Release());
     overlay_layer.SetReleaseFence(layer->release_fence.Release());
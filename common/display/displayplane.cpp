@@ -22,6 +22,7 @@
 #include <hwctrace.h>
 
 #include <overlaylayer.h>
+#include "drmpropertyregistry.h"
 #include "overlaybuffer.h"
 
 namespace hwcomposer {
@@ -29,19 +30,9 @@ namespace hwcomposer {
 DisplayPlane::Property::Property() {
 }
 
-bool DisplayPlane::Property::Initialize(
-    uint32_t fd, const char* name,
-    const ScopedDrmObjectPropertyPtr& plane_props) {
-  uint32_t count_props = plane_props->count_props;
-  for (uint32_t i = 0; i < count_props; i++) {
-    ScopedDrmPropertyPtr property(
-        drmModeGetProperty(fd, plane_props->props[i]));
-    if (property && !strcmp(property->name, name)) {
-      id = property->prop_id;
-      break;
-    }
-  }
-  if (!id) {
+bool DisplayPlane::Property::Initialize(DrmPropertyRegistry& registry,
+                                        uint32_t plane_id, const char* name) {
+  if (!registry.GetPropertyId(plane_id, DRM_MODE_OBJECT_PLANE, name, &id)) {
     ETRACE("Could not find property %s", name);
     return false;
   }
@@ -58,76 +49,67 @@ DisplayPlane::DisplayPlane(uint32_t plane_id, uint32_t possible_crtcs)
 DisplayPlane::~DisplayPlane() {
 }
 
-bool DisplayPlane::Initialize(uint32_t gpu_fd,
+bool DisplayPlane::Initialize(DrmPropertyRegistry& registry,
                               const std::vector<uint32_t>& formats) {
   supported_formats_ = formats;
 
-  ScopedDrmObjectPropertyPtr plane_props(
-      drmModeObjectGetProperties(gpu_fd, id_, DRM_MODE_OBJECT_PLANE));
-  if (!plane_props) {
+  DrmPropertyRegistry::Property type;
+  if (!registry.GetProperty(id_, DRM_MODE_OBJECT_PLANE, "type", &type)) {
     ETRACE("Unable to get plane properties.");
     return false;
   }
-  uint32_t count_props = plane_props->count_props;
-  for (uint32_t i = 0; i < count_props; i++) {
-    ScopedDrmPropertyPtr property(
-        drmModeGetProperty(gpu_fd, plane_props->props[i]));
-    if (property && !strcmp(property->name, "type")) {
-      type_ = plane_props->prop_values[i];
-      break;
-    }
-  }
+  type_ = type.value;
 
-  bool ret = crtc_prop_.Initialize(gpu_fd, "CRTC_ID", plane_props);
+  bool ret = crtc_prop_.Initialize(registry, id_, "CRTC_ID");
   if (!ret)
     return false;
 
-  ret = fb_prop_.Initialize(gpu_fd, "FB_ID", plane_props);
+  ret = fb_prop_.Initialize(registry, id_, "FB_ID");
   if (!ret)
     return false;
 
-  ret = crtc_x_prop_.Initialize(gpu_fd, "CRTC_X", plane_props);
+  ret = crtc_x_prop_.Initialize(registry, id_, "CRTC_X");
   if (!ret)
     return false;
 
-  ret = crtc_y_prop_.Initialize(gpu_fd, "CRTC_Y", plane_props);
+  ret = crtc_y_prop_.Initialize(registry, id_, "CRTC_Y");
   if (!ret)
     return false;
 
-  ret = crtc_w_prop_.Initialize(gpu_fd, "CRTC_W", plane_props);
+  ret = crtc_w_prop_.Initialize(registry, id_, "CRTC_W");
   if (!ret)
     return false;
 
-  ret = crtc_h_prop_.Initialize(gpu_fd, "CRTC_H", plane_props);
+  ret = crtc_h_prop_.Initialize(registry, id_, "CRTC_H");
   if (!ret)
     return false;
 
-  ret = src_x_prop_.Initialize(gpu_fd, "SRC_X", plane_props);
+  ret = src_x_prop_.Initialize(registry, id_, "SRC_X");
   if (!ret)
     return false;
 
-  ret = src_y_prop_.Initialize(gpu_fd, "SRC_Y", plane_props);
+  ret = src_y_prop_.Initialize(registry, id_, "SRC_Y");
   if (!ret)
     return false;
 
-  ret = src_w_prop_.Initialize(gpu_fd, "SRC_W", plane_props);
+  ret = src_w_prop_.Initialize(registry, id_, "SRC_W");
   if (!ret)
     return false;
 
-  ret = src_h_prop_.Initialize(gpu_fd, "SRC_H", plane_props);
+  ret = src_h_prop_.Initialize(registry, id_, "SRC_H");
   if (!ret)
     return false;
 
-  ret = rotation_prop_.Initialize(gpu_fd, "rotation", plane_props);
+  ret = rotation_prop_.Initialize(registry, id_, "rotation");
   if (!ret)
     ETRACE("Could not get rotation property");
 
-  ret = alpha_prop_.Initialize(gpu_fd, "alpha", plane_props);
+  ret = alpha_prop_.Initialize(registry, id_, "alpha");
   if (!ret)
     ETRACE("Could not get alpha property");
 
 #ifndef DISABLE_EXPLICIT_SYNC
-  ret = in_fence_fd_prop_.Initialize(gpu_fd, "IN_FENCE_FD", plane_props);
+  ret = in_fence_fd_prop_.Initialize(registry, id_, "IN_FENCE_FD");
   if (!ret)
     ETRACE("Could not get IN_FENCE_FD property");
 #else
@@ -137,6 +119,19 @@ bool DisplayPlane::Initialize(uint32_t gpu_fd,
   return true;
 }
 
+bool DisplayPlane::AddProperty(drmModeAtomicReqPtr property_set,
+                               const Property& property,
+                               uint64_t value) const {
+  if (!property.id)
+    return true;
+
+  pending_properties_.emplace_back(&property, value);
+  if (property.committed && property.value == value)
+    return true;
+
+  return drmModeAtomicAddProperty(property_set, id_, property.id, value) >= 0;
+}
+
 bool DisplayPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
                                     uint32_t crtc_id,
                                     const OverlayLayer* layer) const {
@@ -150,59 +145,49 @@ bool DisplayPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
 
   IDISPLAYMANAGERTRACE("buffer->GetFb() ---------------------- STARTS %d",
                        buffer->GetFb());
-  int success =
-      drmModeAtomicAddProperty(property_set, id_, crtc_prop_.id, crtc_id) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, fb_prop_.id,
-                                      buffer->GetFb()) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, crtc_x_prop_.id,
-                                      display_frame.left) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, crtc_y_prop_.id,
-                                      display_frame.top) < 0;
+  pending_properties_.clear();
+  bool success = AddProperty(property_set, crtc_prop_, crtc_id);
+  success &= AddProperty(property_set, fb_prop_, buffer->GetFb());
+  success &= AddProperty(property_set, crtc_x_prop_, display_frame.left);
+  success &= AddProperty(property_set, crtc_y_prop_, display_frame.top);
   if (type_ == DRM_PLANE_TYPE_CURSOR) {
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_w_prop_.id,
-                                        buffer->GetWidth()) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_h_prop_.id,
-                                        buffer->GetHeight()) < 0;
+    success &= AddProperty(property_set, crtc_w_prop_, buffer->GetWidth());
+    success &= AddProperty(property_set, crtc_h_prop_, buffer->GetHeight());
   } else {
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_w_prop_.id,
-                                        layer->GetDisplayFrameWidth()) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_h_prop_.id,
-                                        layer->GetDisplayFrameHeight()) < 0;
+    success &= AddProperty(property_set, crtc_w_prop_,
+                           layer->GetDisplayFrameWidth());
+    success &= AddProperty(property_set, crtc_h_prop_,
+                           layer->GetDisplayFrameHeight());
   }
 
-  success |= drmModeAtomicAddProperty(property_set, id_, src_x_prop_.id,
-                                      (int)(source_crop.left) << 16) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, src_y_prop_.id,
-                                      (int)(source_crop.top) << 16) < 0;
+  success &= AddProperty(property_set, src_x_prop_,
+                         (int)(source_crop.left) << 16);
+  success &=
+      AddProperty(property_set, src_y_prop_, (int)(source_crop.top) << 16);
   if (type_ == DRM_PLANE_TYPE_CURSOR) {
-    success |= drmModeAtomicAddProperty(property_set, id_, src_w_prop_.id,
-                                        buffer->GetWidth() << 16) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, src_h_prop_.id,
-                                        buffer->GetHeight() << 16) < 0;
+    success &=
+        AddProperty(property_set, src_w_prop_, buffer->GetWidth() << 16);
+    success &=
+        AddProperty(property_set, src_h_prop_, buffer->GetHeight() << 16);
   } else {
-    success |= drmModeAtomicAddProperty(property_set, id_, src_w_prop_.id,
-                                        layer->GetSourceCropWidth() << 16) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, src_h_prop_.id,
-                                        layer->GetSourceCropHeight() << 16) < 0;
-  }
-
-  if (rotation_prop_.id) {
-    success = drmModeAtomicAddProperty(property_set, id_, rotation_prop_.id,
-                                       layer->GetRotation()) < 0;
+    success &= AddProperty(property_set, src_w_prop_,
+                           layer->GetSourceCropWidth() << 16);
+    success &= AddProperty(property_set, src_h_prop_,
+                           layer->GetSourceCropHeight() << 16);
   }
 
-  if (alpha_prop_.id) {
-    success =
-        drmModeAtomicAddProperty(property_set, id_, alpha_prop_.id, alpha) < 0;
-  }
+  success &= AddProperty(property_set, rotation_prop_, layer->GetRotation());
+  success &= AddProperty(property_set, alpha_prop_, alpha);
 #ifndef DISABLE_EXPLICIT_SYNC
+  // The fence belongs to this commit only, it is never part of the
+  // committed state.
   if (fence != -1 && in_fence_fd_prop_.id) {
-    success = drmModeAtomicAddProperty(property_set, id_, in_fence_fd_prop_.id,
-                                       fence) < 0;
+    success &= drmModeAtomicAddProperty(property_set, id_,
+                                        in_fence_fd_prop_.id, fence) >= 0;
   }
 #endif
 
-  if (success) {
+  if (!success) {
     ETRACE("Could not update properties for plane with id: %d", id_);
     return false;
   }
@@ -211,13 +196,27 @@ bool DisplayPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
   return true;
 }
 
+bool DisplayPlane::UpdatePosition(drmModeAtomicReqPtr property_set, int32_t x,
+                                  int32_t y) const {
+  pending_properties_.clear();
+  bool success = AddProperty(property_set, crtc_x_prop_, x);
+  success &= AddProperty(property_set, crtc_y_prop_, y);
+
+  if (!success) {
+    ETRACE("Could not update position for plane with id: %d", id_);
+    return false;
+  }
+
+  return true;
+}
+
 bool DisplayPlane::Disable(drmModeAtomicReqPtr property_set) {
   enabled_ = false;
-  int success =
-      drmModeAtomicAddProperty(property_set, id_, crtc_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, fb_prop_.id, 0) < 0;
+  pending_properties_.clear();
+  bool success = AddProperty(property_set, crtc_prop_, 0);
+  success &= AddProperty(property_set, fb_prop_, 0);
 
-  if (success) {
+  if (!success) {
     ETRACE("Failed to disable plane with id: %d", id_);
     return false;
   }
@@ -225,6 +224,29 @@ bool DisplayPlane::Disable(drmModeAtomicReqPtr property_set) {
   return true;
 }
 
+void DisplayPlane::ApplyPendingProperties() {
+  for (const std::pair<const Property*, uint64_t>& pending :
+       pending_properties_) {
+    pending.first->value = pending.second;
+    pending.first->committed = true;
+  }
+
+  pending_properties_.clear();
+}
+
+void DisplayPlane::InvalidateCommittedProperties() {
+  const Property* properties[] = {&crtc_prop_,     &fb_prop_,
+                                  &crtc_x_prop_,   &crtc_y_prop_,
+                                  &crtc_w_prop_,   &crtc_h_prop_,
+                                  &src_x_prop_,    &src_y_prop_,
+                                  &src_w_prop_,    &src_h_prop_,
+                                  &rotation_prop_, &alpha_prop_};
+  for (const Property* property : properties)
+    property->committed = false;
+
+  pending_properties_.clear();
+}
+
 uint32_t DisplayPlane::id() const {
   return id_;
 }
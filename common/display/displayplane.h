@@ -17,6 +17,7 @@
 #ifndef DISPLAY_PLANE_H_
 #define DISPLAY_PLANE_H_
 
+#include <utility>
 #include <vector>
 
 #include <stdlib.h>
@@ -27,6 +28,7 @@
 
 namespace hwcomposer {
 
+class DrmPropertyRegistry;
 class GpuDevice;
 struct OverlayLayer;
 
@@ -36,15 +38,30 @@ class DisplayPlane {
 
   ~DisplayPlane();
 
-  bool Initialize(uint32_t gpu_fd, const std::vector<uint32_t>& formats);
+  bool Initialize(DrmPropertyRegistry& registry,
+                  const std::vector<uint32_t>& formats);
 
+  // Only properties whose value differs from the last committed one are
+  // added to |property_set|. The values are remembered as pending until
+  // ApplyPendingProperties is called after a successful commit.
   bool UpdateProperties(drmModeAtomicReqPtr property_set, uint32_t crtc_id,
                         const OverlayLayer* layer) const;
 
+  // Only updates CRTC_X and CRTC_Y, everything else stays as committed.
+  bool UpdatePosition(drmModeAtomicReqPtr property_set, int32_t x,
+                      int32_t y) const;
+
   bool ValidateLayer(const OverlayLayer* layer);
 
   bool Disable(drmModeAtomicReqPtr property_set);
 
+  // Records the values added by the last UpdateProperties, UpdatePosition or
+  // Disable call as committed.
+  void ApplyPendingProperties();
+
+  // Forgets the committed values, the next request carries every property.
+  void InvalidateCommittedProperties();
+
   uint32_t id() const;
 
   bool GetCrtcSupported(uint32_t pipe_id) const;
@@ -66,11 +83,17 @@ class DisplayPlane {
  private:
   struct Property {
     Property();
-    bool Initialize(uint32_t fd, const char* name,
-                    const ScopedDrmObjectPropertyPtr& plane_properties);
+    bool Initialize(DrmPropertyRegistry& registry, uint32_t plane_id,
+                    const char* name);
     uint32_t id = 0;
+    // Value as last committed to the kernel.
+    mutable uint64_t value = 0;
+    mutable bool committed = false;
   };
 
+  bool AddProperty(drmModeAtomicReqPtr property_set, const Property& property,
+                   uint64_t value) const;
+
   Property crtc_prop_;
   Property fb_prop_;
   Property crtc_x_prop_;
@@ -96,6 +119,8 @@ class DisplayPlane {
   bool enabled_;
 
   std::vector<uint32_t> supported_formats_;
+
+  mutable std::vector<std::pair<const Property*, uint64_t>> pending_properties_;
 };
 
 }  // namespace hwcomposer
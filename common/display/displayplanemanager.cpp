@@ -16,6 +16,11 @@
 
 #include "displayplanemanager.h"
 
+#include <inttypes.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
 #include <set>
 #include <utility>
 
@@ -24,24 +29,44 @@
 #include <overlaylayer.h>
 #include <nativebufferhandler.h>
 
+#include "bufferimportlog.h"
 #include "displayplane.h"
+#include "drmpropertyregistry.h"
 #include "factory.h"
 #include "hwctrace.h"
+#include "hwcutils.h"
 #include "nativesurface.h"
 #include "nativesync.h"
 #include "overlaybuffer.h"
 
 namespace hwcomposer {
 
+// Number of test commit results we remember and the largest plane
+// combination we remember them for.
+static const size_t kTestVerdictCacheSize = 64;
+static const size_t kMaxCachedPlaneCombination = 4;
+// Buffers are dropped from buffer_cache_ once they are destroyed. This only
+// bounds it for clients keeping many more buffers alive than they show,
+// the least recently shown ones lose their framebuffer first.
+static const size_t kMaxCachedBuffers = 64;
+// Vblanks a frame commit waits out while the pipe reports it busy.
+static const int kMaxBusyCommitVBlanks = 2;
+
 DisplayPlaneManager::DisplayPlaneManager(int gpu_fd, uint32_t pipe_id,
                                          uint32_t crtc_id)
-    : crtc_id_(crtc_id), pipe_(pipe_id), gpu_fd_(gpu_fd) {
+    : test_verdicts_(kTestVerdictCacheSize),
+      crtc_id_(crtc_id),
+      pipe_(pipe_id),
+      gpu_fd_(gpu_fd) {
+  allocation_strategy_ =
+      CreatePlaneAllocationStrategy(HWCPlaneAllocation::kGreedy);
 }
 
 DisplayPlaneManager::~DisplayPlaneManager() {
 }
 
 bool DisplayPlaneManager::Initialize(NativeBufferHandler *buffer_handler,
+                                     DrmPropertyRegistry *property_registry,
                                      uint32_t width, uint32_t height) {
   ScopedDrmPlaneResPtr plane_resources(drmModeGetPlaneResources(gpu_fd_));
   if (!plane_resources) {
@@ -71,7 +96,7 @@ bool DisplayPlaneManager::Initialize(NativeBufferHandler *buffer_handler,
     for (uint32_t j = 0; j < formats_size; j++)
       supported_formats[j] = drm_plane->formats[j];
 
-    if (plane->Initialize(gpu_fd_, supported_formats)) {
+    if (plane->Initialize(*property_registry, supported_formats)) {
       if (plane->type() == DRM_PLANE_TYPE_CURSOR) {
         cursor_plane_.reset(plane.release());
       } else if (plane->type() == DRM_PLANE_TYPE_PRIMARY) {
@@ -95,9 +120,20 @@ bool DisplayPlaneManager::Initialize(NativeBufferHandler *buffer_handler,
          const std::unique_ptr<DisplayPlane> &r) { return l->id() < r->id(); });
 
   buffer_handler_ = buffer_handler;
+  release_log_position_ = BufferImportLog::GetInstance().GetPosition();
   width_ = width;
   height_ = height;
 
+  plane_set_signature_ = HashCombine(0, primary_plane_->id());
+  for (auto &plane : overlay_planes_)
+    plane_set_signature_ = HashCombine(plane_set_signature_, plane->id());
+
+  if (cursor_plane_)
+    plane_set_signature_ =
+        HashCombine(plane_set_signature_, cursor_plane_->id());
+
+  InvalidateValidationCache();
+
   return true;
 }
 
@@ -109,156 +145,135 @@ bool DisplayPlaneManager::BeginFrameUpdate(std::vector<OverlayLayer> &layers) {
     (*i)->SetEnabled(false);
   }
 
+  frame_++;
+  DropReleasedBuffers();
   size_t size = layers.size();
-  std::vector<std::unique_ptr<OverlayBuffer>>().swap(in_flight_buffers_);
+  in_flight_buffers_.clear();
+  layer_buffers_.resize(size);
   for (size_t layer_index = 0; layer_index < size; layer_index++) {
     OverlayLayer *layer = &layers.at(layer_index);
+    LayerBuffer &layer_buffer = layer_buffers_.at(layer_index);
+    // Native handles may stay the same while the buffer behind them
+    // changes, only the import tells buffers apart. Imports are cached by
+    // the buffer handler, so this is cheap for buffers seen before.
     HwcBuffer bo;
     if (!buffer_handler_->ImportBuffer(layer->GetNativeHandle(), &bo)) {
       ETRACE("Failed to Import buffer.");
+      layer_buffer.buffer.reset();
       return false;
     }
 
-    in_flight_buffers_.emplace_back(new OverlayBuffer());
-    OverlayBuffer *buffer = in_flight_buffers_.back().get();
-    buffer->Initialize(bo);
-    layer->SetBuffer(buffer);
-  }
+    if (layer_buffer.buffer && bo.import_id &&
+        layer_buffer.key == bo.import_id) {
+      auto it = buffer_cache_.find(layer_buffer.key);
+      if (it != buffer_cache_.end() &&
+          it->second.buffer == layer_buffer.buffer)
+        it->second.last_used_frame = frame_;
+    } else {
+      layer_buffer.buffer = GetOverlayBuffer(bo, &layer_buffer.key);
+    }
 
-  if (!in_flight_surfaces_.empty())
-    std::vector<NativeSurface *>().swap(in_flight_surfaces_);
+    in_flight_buffers_.emplace_back(layer_buffer.buffer);
+    layer->SetBuffer(layer_buffer.buffer.get());
+  }
 
+  in_flight_surfaces_.clear();
+  in_flight_targets_.clear();
   return true;
 }
 
-std::tuple<bool, DisplayPlaneStateList> DisplayPlaneManager::ValidateLayers(
-    std::vector<OverlayLayer> &layers, bool pending_modeset) {
+bool DisplayPlaneManager::ValidateLayers(std::vector<OverlayLayer> &layers,
+                                         bool pending_modeset,
+                                         DisplayPlaneStateList &composition) {
   CTRACE();
-  DisplayPlaneStateList composition;
-  std::vector<OverlayPlane> commit_planes;
-  OverlayLayer *cursor_layer = NULL;
-  auto layer_begin = layers.begin();
-  auto layer_end = layers.end();
+  composition.clear();
   bool render_layers = false;
-  // We start off with Primary plane.
-  DisplayPlane *current_plane = primary_plane_.get();
-
-  OverlayLayer *primary_layer = &(*(layers.begin()));
-  commit_planes.emplace_back(OverlayPlane(current_plane, primary_layer));
-  composition.emplace_back(current_plane, primary_layer,
-                           primary_layer->GetIndex());
-  ++layer_begin;
-  // Lets ensure we fall back to GPU composition in case
-  // primary layer cannot be scanned out directly.
-  if ((pending_modeset && layers.size() > 1) ||
-      FallbacktoGPU(current_plane, primary_layer, commit_planes)) {
-    DisplayPlaneState &last_plane = composition.back();
-    render_layers = true;
-    // Case where we have just one layer which needs to be composited using
-    // GPU.
-    last_plane.ForceGPURendering();
-
-    for (auto i = layer_begin; i != layer_end; ++i) {
-      last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
+  uint64_t signature = 0;
+  if (pending_modeset) {
+    InvalidateValidationCache();
+  } else {
+    signature = GetLayerStackSignature(layers);
+    if (cached_layout_valid_ && cached_signature_ == signature) {
+      if (ApplyCachedLayout(layers, composition, &render_layers)) {
+        validation_stats_.hits++;
+        validation_stats_.last_frame_test_commits = 0;
+        validation_stats_.test_commits_saved += cached_test_commits_;
+        IDISPLAYMANAGERTRACE(
+            "Validation cache hit. Hits: %" PRIu64 " Misses: %" PRIu64
+            " Test commits saved: %" PRIu64,
+            validation_stats_.hits, validation_stats_.misses,
+            validation_stats_.test_commits_saved);
+        if (render_layers)
+          ReuseOffScreenTargets(layers, composition);
+
+        return render_layers;
+      }
     }
-
-    EnsureOffScreenTarget(last_plane);
-    // We need to composite primary using GPU, lets use this for
-    // all layers in this case.
-    return std::make_tuple(render_layers, std::move(composition));
-  }
-
-  // We are just compositing Primary layer and nothing else.
-  if (layers.size() == 1) {
-    return std::make_tuple(render_layers, std::move(composition));
   }
 
-  // Retrieve cursor layer data and delete it from the layers.
-  for (auto j = layers.rbegin(); j != layers.rend(); ++j) {
-    if (j->GetBuffer()->GetUsage() & kLayerCursor) {
-      cursor_layer = &(*(j));
-      layer_end = std::next(j).base();
-      break;
-    }
+  validation_stats_.misses++;
+  uint64_t test_commits = validation_stats_.test_commits;
+  auto start = std::chrono::steady_clock::now();
+  PlaneAllocationContext context(*this);
+  render_layers = allocation_strategy_->Allocate(context, layers,
+                                                 pending_modeset, composition);
+  uint64_t decision_time_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count();
+
+  test_commits = validation_stats_.test_commits - test_commits;
+  validation_stats_.last_frame_test_commits = test_commits;
+  allocation_strategy_->UpdateStats(test_commits, decision_time_us);
+  IDISPLAYMANAGERTRACE("%s allocation used %" PRIu64
+                       " test commits and %" PRIu64 "us to validate frame.",
+                       allocation_strategy_->Name(), test_commits,
+                       decision_time_us);
+  if (!pending_modeset) {
+    CacheLayout(signature, composition, test_commits);
+    if (render_layers)
+      ReuseOffScreenTargets(layers, composition);
   }
 
-  if (layer_begin != layer_end) {
-    // Handle layers for overlay
-    uint32_t index = 0;
-    for (auto j = overlay_planes_.begin(); j != overlay_planes_.end(); ++j) {
-      DisplayPlaneState &last_plane = composition.back();
-      // Handle remaining overlay planes.
-      for (auto i = layer_begin; i != layer_end; ++i) {
-        OverlayLayer *layer = &(*(i));
-        commit_planes.emplace_back(OverlayPlane(j->get(), layer));
-        index = i->GetIndex();
-        ++layer_begin;
-        // If we are able to composite buffer with the given plane, lets use
-        // it.
-        if (!FallbacktoGPU(j->get(), layer, commit_planes)) {
-          composition.emplace_back(j->get(), layer, index);
-          break;
-        } else {
-          last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
-          commit_planes.pop_back();
-        }
-      }
-
-      if (last_plane.GetCompositionState() == DisplayPlaneState::State::kRender)
-	render_layers = true;
-    }
+  return render_layers;
+}
 
+bool DisplayPlaneManager::BuildComposition(std::vector<OverlayLayer> &layers,
+                                           const std::vector<size_t> &starts,
+                                           size_t layers_end,
+                                           OverlayLayer *cursor_layer,
+                                           DisplayPlaneStateList &composition) {
+  bool render_layers = false;
+  size_t planes = starts.size();
+  for (size_t i = 0; i < planes; i++) {
+    DisplayPlane *plane =
+        i == 0 ? primary_plane_.get() : overlay_planes_.at(i - 1).get();
+    OverlayLayer *layer = &layers.at(starts.at(i));
+    composition.emplace_back().Reset(plane, layer, layer->GetIndex());
     DisplayPlaneState &last_plane = composition.back();
-    // We dont have any additional planes. Pre composite remaining layers
-    // to the last overlay plane.
-    for (auto i = layer_begin; i != layer_end; ++i) {
-      last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
+    size_t end = i + 1 < planes ? starts.at(i + 1) : layers_end;
+    for (size_t j = starts.at(i) + 1; j < end; j++) {
+      last_plane.AddLayer(layers.at(j).GetIndex(),
+                          layers.at(j).GetDisplayFrame());
     }
 
-    if (last_plane.GetCompositionState() == DisplayPlaneState::State::kRender)
+    if (last_plane.GetCompositionState() == DisplayPlaneState::State::kRender) {
+      EnsureOffScreenTarget(last_plane);
       render_layers = true;
-  }
-
-  // Handle Cursor layer.
-  DisplayPlane *cursor_plane = NULL;
-  if (cursor_layer) {
-    // Handle Cursor layer. If we have dedicated cursor plane, try using it
-    // to composite cursor layer.
-    if (cursor_plane_)
-      cursor_plane = cursor_plane_.get();
-    if (cursor_plane) {
-      commit_planes.emplace_back(OverlayPlane(cursor_plane, cursor_layer));
-      // Lets ensure we fall back to GPU composition in case
-      // cursor layer cannot be scanned out directly.
-      if (FallbacktoGPU(cursor_plane, cursor_layer, commit_planes)) {
-        cursor_plane = NULL;
-      }
-    }
-
-    // We need to do this here to avoid compositing cursor with any previous
-    // pre-composited planes.
-    if (cursor_plane) {
-      composition.emplace_back(cursor_plane, cursor_layer,
-                               cursor_layer->GetIndex());
-    } else {
-      DisplayPlaneState &last_plane = composition.back();
-      render_layers = true;
-      last_plane.AddLayer(cursor_layer->GetIndex(),
-                          cursor_layer->GetDisplayFrame());
     }
   }
 
-  if (render_layers) {
-    ValidateFinalLayers(composition, layers);
-  }
+  if (cursor_layer)
+    composition.emplace_back().Reset(cursor_plane_.get(), cursor_layer,
+                                     cursor_layer->GetIndex());
 
-  return std::make_tuple(render_layers, std::move(composition));
+  return render_layers;
 }
 
 bool DisplayPlaneManager::CommitFrame(DisplayPlaneStateList &comp_planes,
                                       drmModeAtomicReqPtr pset,
                                       bool needs_modeset,
-                                      std::unique_ptr<NativeSync> &sync_object,
+                                      NativeSync *sync_object,
                                       ScopedFd &fence) {
   CTRACE();
   if (!pset) {
@@ -277,6 +292,10 @@ bool DisplayPlaneManager::CommitFrame(DisplayPlaneStateList &comp_planes,
 #endif
   }
 
+  // A modeset may reset plane state, send every property again.
+  if (needs_modeset)
+    InvalidateCommittedProperties();
+
   for (DisplayPlaneState &comp_plane : comp_planes) {
     DisplayPlane *plane = comp_plane.plane();
     OverlayLayer *layer = comp_plane.GetOverlayLayer();
@@ -310,6 +329,12 @@ bool DisplayPlaneManager::CommitFrame(DisplayPlaneStateList &comp_planes,
       }
 
       ret = drmModeAtomicCommit(gpu_fd_, pset, flags, NULL);
+      // A cursor only commit from SetCursorPosition may still be pending,
+      // it completes with the next vblank.
+      for (int i = 0; ret == -EBUSY && i < kMaxBusyCommitVBlanks; i++) {
+        WaitForVBlank();
+        ret = drmModeAtomicCommit(gpu_fd_, pset, flags, NULL);
+      }
 #else
       /* FIXME - In case of EBUSY, we spin until succeed. What we
        * probably should do is to queue commits and process them later.
@@ -325,15 +350,34 @@ bool DisplayPlaneManager::CommitFrame(DisplayPlaneStateList &comp_planes,
 
   if (ret) {
     ETRACE("Failed to commit pset ret=%s\n", PRINTERROR());
+    InvalidateValidationCache();
+    InvalidateCommittedProperties();
+    cursor_committed_ = false;
     return false;
   }
 
-  if (!needs_modeset)
-    current_sync_.reset(sync_object.release());
+  primary_plane_->ApplyPendingProperties();
+  for (auto &plane : overlay_planes_)
+    plane->ApplyPendingProperties();
 
+  if (cursor_plane_)
+    cursor_plane_->ApplyPendingProperties();
+
+  cursor_committed_ = cursor_plane_ && cursor_plane_->IsEnabled();
   return true;
 }
 
+void DisplayPlaneManager::WaitForVBlank() const {
+  uint32_t high_crtc = (pipe_ << DRM_VBLANK_HIGH_CRTC_SHIFT);
+  drmVBlank vblank;
+  memset(&vblank, 0, sizeof(vblank));
+  vblank.request.type = (drmVBlankSeqType)(
+      DRM_VBLANK_RELATIVE | (high_crtc & DRM_VBLANK_HIGH_CRTC_MASK));
+  vblank.request.sequence = 1;
+  if (drmWaitVBlank(gpu_fd_, &vblank))
+    IDISPLAYMANAGERTRACE("Failed to wait for vblank. %s ", PRINTERROR());
+}
+
 void DisplayPlaneManager::DisablePipe(drmModeAtomicReqPtr property_set) {
   CTRACE();
   // Disable planes.
@@ -350,18 +394,62 @@ void DisplayPlaneManager::DisablePipe(drmModeAtomicReqPtr property_set) {
                                 DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
   if (ret)
     ETRACE("Failed to disable pipe:%s\n", PRINTERROR());
+
+  cursor_committed_ = false;
+  std::vector<RenderTarget>().swap(displayed_targets_);
+  buffer_cache_.clear();
+  layer_buffers_.clear();
+  InvalidateValidationCache();
+  InvalidateCommittedProperties();
+}
+
+int DisplayPlaneManager::UpdateCursorPosition(int32_t x, int32_t y) {
+  CTRACE();
+  if (!cursor_committed_)
+    return -EINVAL;
+
+  if (!cursor_pset_)
+    cursor_pset_.reset(drmModeAtomicAlloc());
+  else
+    drmModeAtomicSetCursor(cursor_pset_.get(), 0);
+
+  if (!cursor_pset_ || !cursor_plane_->UpdatePosition(cursor_pset_.get(), x, y))
+    return -EINVAL;
+
+  // Nothing to do if the cursor is already there.
+  if (!drmModeAtomicGetCursor(cursor_pset_.get()))
+    return 0;
+
+  int ret = drmModeAtomicCommit(gpu_fd_, cursor_pset_.get(),
+                                DRM_MODE_ATOMIC_NONBLOCK, NULL);
+  if (ret) {
+    IDISPLAYMANAGERTRACE("Failed to move cursor plane. %s ", PRINTERROR());
+    return ret == -EBUSY ? -EBUSY : -EINVAL;
+  }
+
+  cursor_plane_->ApplyPendingProperties();
+  return 0;
 }
 
 bool DisplayPlaneManager::TestCommit(
     const std::vector<OverlayPlane> &commit_planes) const {
-  ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
+  validation_stats_.test_commits++;
+  // The request is only rolled back between probes, not reallocated.
+  if (!test_pset_)
+    test_pset_.reset(drmModeAtomicAlloc());
+  else
+    drmModeAtomicSetCursor(test_pset_.get(), 0);
+
+  if (!test_pset_)
+    return false;
+
   for (auto i = commit_planes.begin(); i != commit_planes.end(); i++) {
-    if (!(i->plane->UpdateProperties(pset.get(), crtc_id_, i->layer))) {
+    if (!(i->plane->UpdateProperties(test_pset_.get(), crtc_id_, i->layer))) {
       return false;
     }
   }
 
-  if (drmModeAtomicCommit(gpu_fd_, pset.get(), DRM_MODE_ATOMIC_TEST_ONLY,
+  if (drmModeAtomicCommit(gpu_fd_, test_pset_.get(), DRM_MODE_ATOMIC_TEST_ONLY,
                           NULL)) {
     IDISPLAYMANAGERTRACE("Test Commit Failed. %s ", PRINTERROR());
     return false;
@@ -370,18 +458,111 @@ bool DisplayPlaneManager::TestCommit(
   return true;
 }
 
+bool DisplayPlaneManager::TestCommitCached(
+    const std::vector<OverlayPlane> &commit_planes) const {
+  if (commit_planes.size() > kMaxCachedPlaneCombination)
+    return TestCommit(commit_planes);
+
+  uint64_t key = HashCombine(0, commit_planes.size());
+  for (const OverlayPlane &commit_plane : commit_planes) {
+    const OverlayLayer *layer = commit_plane.layer;
+    const OverlayBuffer *buffer = layer->GetBuffer();
+    uint32_t alpha = 0xFF;
+    if (layer->GetBlending() == HWCBlending::kBlendingPremult)
+      alpha = layer->GetAlpha();
+
+    key = HashCombine(key, commit_plane.plane->id());
+    key = HashCombine(key, buffer->GetFormat());
+    if (commit_plane.plane->type() == DRM_PLANE_TYPE_CURSOR) {
+      key = HashCombine(key, buffer->GetWidth());
+      key = HashCombine(key, buffer->GetHeight());
+    } else {
+      key = HashCombine(key, layer->GetSourceCropWidth());
+      key = HashCombine(key, layer->GetSourceCropHeight());
+      key = HashCombine(key, layer->GetDisplayFrameWidth());
+      key = HashCombine(key, layer->GetDisplayFrameHeight());
+    }
+    key = HashCombine(key, layer->GetRotation());
+    key = HashCombine(key, alpha);
+  }
+
+  bool *verdict = test_verdicts_.Find(key);
+  if (verdict) {
+    validation_stats_.verdict_hits++;
+    return *verdict;
+  }
+
+  validation_stats_.verdict_misses++;
+  bool result = TestCommit(commit_planes);
+  test_verdicts_.Insert(key, result);
+  return result;
+}
+
 void DisplayPlaneManager::EndFrameUpdate() {
   for (auto &fb : surfaces_) {
     fb->SetInUse(false);
   }
 
   displayed_buffers_.swap(in_flight_buffers_);
+  displayed_targets_.swap(in_flight_targets_);
+  TrimBufferCache();
+  in_flight_targets_.clear();
 
   for (auto &fb : in_flight_surfaces_) {
     fb->SetInUse(true);
   }
 }
 
+std::shared_ptr<OverlayBuffer> DisplayPlaneManager::GetOverlayBuffer(
+    const HwcBuffer &bo, uint64_t *key_out) {
+  *key_out = bo.import_id;
+  if (!bo.import_id) {
+    // Imported again every frame, there is no telling whether it is the
+    // buffer of an earlier frame.
+    std::shared_ptr<OverlayBuffer> buffer = std::make_shared<OverlayBuffer>();
+    buffer->Initialize(bo);
+    return buffer;
+  }
+
+  CachedBuffer &cached = buffer_cache_[bo.import_id];
+  cached.last_used_frame = frame_;
+  if (!cached.buffer) {
+    cached.buffer = std::make_shared<OverlayBuffer>();
+    cached.buffer->Initialize(bo);
+  }
+
+  return cached.buffer;
+}
+
+void DisplayPlaneManager::DropReleasedBuffers() {
+  released_imports_.clear();
+  if (!BufferImportLog::GetInstance().GetReleased(&release_log_position_,
+                                                  &released_imports_)) {
+    // Lost track, only keep what this frame may still use.
+    buffer_cache_.clear();
+    return;
+  }
+
+  for (uint64_t import_id : released_imports_)
+    buffer_cache_.erase(import_id);
+}
+
+void DisplayPlaneManager::TrimBufferCache() {
+  while (buffer_cache_.size() > kMaxCachedBuffers) {
+    auto oldest = buffer_cache_.begin();
+    for (auto it = buffer_cache_.begin(); it != buffer_cache_.end(); ++it) {
+      if (it->second.last_used_frame < oldest->second.last_used_frame)
+        oldest = it;
+    }
+
+    // Everything left is shown right now.
+    if (oldest->second.last_used_frame == frame_)
+      break;
+
+    buffer_cache_.erase(oldest);
+  }
+}
+
 void DisplayPlaneManager::EnsureOffScreenTarget(DisplayPlaneState &plane) {
   NativeSurface *surface = NULL;
   for (auto &fb : surfaces_) {
@@ -411,9 +592,7 @@ void DisplayPlaneManager::ValidateFinalLayers(
     }
   }
 
-  for (auto &fb : in_flight_surfaces_) {
-    fb->ResetInFlightMode();
-  }
+  ResetInFlightTargets();
 
   std::vector<OverlayPlane> commit_planes;
   for (DisplayPlaneState &plane : composition) {
@@ -422,52 +601,263 @@ void DisplayPlaneManager::ValidateFinalLayers(
   }
 
   // If this combination fails just fall back to 3D for all layers.
-  if (!TestCommit(commit_planes)) {
+  if (!TestCommitCached(commit_planes)) {
     std::vector<NativeSurface *>().swap(in_flight_surfaces_);
-    // We start off with Primary plane.
-    DisplayPlane *current_plane = primary_plane_.get();
-    DisplayPlaneStateList().swap(composition);
-    auto layer_begin = layers.begin();
-    OverlayLayer *primary_layer = &(*(layer_begin));
-    commit_planes.emplace_back(OverlayPlane(current_plane, primary_layer));
-    composition.emplace_back(current_plane, primary_layer,
-                             primary_layer->GetIndex());
-    DisplayPlaneState &last_plane = composition.back();
-    last_plane.ForceGPURendering();
-    ++layer_begin;
+    ComposeAllLayersOnPrimary(layers, composition);
+  }
+}
 
-    for (auto i = layer_begin; i != layers.end(); ++i) {
-      last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
-    }
+void DisplayPlaneManager::ComposeAllLayersOnPrimary(
+    std::vector<OverlayLayer> &layers, DisplayPlaneStateList &composition) {
+  // We start off with Primary plane.
+  DisplayPlane *current_plane = primary_plane_.get();
+  composition.clear();
+  auto layer_begin = layers.begin();
+  OverlayLayer *primary_layer = &(*(layer_begin));
+  composition.emplace_back().Reset(current_plane, primary_layer,
+                                   primary_layer->GetIndex());
+  DisplayPlaneState &last_plane = composition.back();
+  last_plane.ForceGPURendering();
+  ++layer_begin;
 
-    EnsureOffScreenTarget(last_plane);
+  for (auto i = layer_begin; i != layers.end(); ++i) {
+    last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
   }
+
+  EnsureOffScreenTarget(last_plane);
+}
+
+void DisplayPlaneManager::ReleaseOffScreenTargets() {
+  ResetInFlightTargets();
+  std::vector<NativeSurface *>().swap(in_flight_surfaces_);
 }
 
 bool DisplayPlaneManager::FallbacktoGPU(
     DisplayPlane *target_plane, OverlayLayer *layer,
     const std::vector<OverlayPlane> &commit_planes) const {
+  if (!CanScanout(target_plane, layer))
+    return true;
+
+  // TODO(kalyank): Take relevant factors into consideration to determine if
+  // Plane Composition makes sense. i.e. layer size etc
+
+  if (!TestCommitCached(commit_planes)) {
+    return true;
+  }
+
+  return false;
+}
+
+bool DisplayPlaneManager::CanScanout(DisplayPlane *target_plane,
+                                     OverlayLayer *layer) const {
 #ifdef DISABLE_OVERLAY_USAGE
-  return true;
+  return false;
 #endif
 
   if (!target_plane->ValidateLayer(layer))
-    return true;
+    return false;
 
   if (layer->GetBuffer()->GetFb() == 0) {
     if (!layer->GetBuffer()->CreateFrameBuffer(gpu_fd_)) {
-      return true;
+      return false;
     }
   }
 
-  // TODO(kalyank): Take relevant factors into consideration to determine if
-  // Plane Composition makes sense. i.e. layer size etc
+  return true;
+}
 
-  if (!TestCommit(commit_planes)) {
-    return true;
+void DisplayPlaneManager::ResetInFlightTargets() {
+  for (auto &fb : in_flight_surfaces_) {
+    fb->ResetInFlightMode();
   }
+}
 
-  return false;
+void DisplayPlaneManager::SetAllocationStrategy(
+    HWCPlaneAllocation allocation) {
+  if (allocation_strategy_ && allocation_strategy_->Type() == allocation)
+    return;
+
+  allocation_strategy_ = CreatePlaneAllocationStrategy(allocation);
+  InvalidateValidationCache();
+}
+
+void DisplayPlaneManager::InvalidateCommittedProperties() {
+  primary_plane_->InvalidateCommittedProperties();
+  for (auto &plane : overlay_planes_)
+    plane->InvalidateCommittedProperties();
+
+  if (cursor_plane_)
+    cursor_plane_->InvalidateCommittedProperties();
+}
+
+void DisplayPlaneManager::InvalidateValidationCache() {
+  cached_layout_valid_ = false;
+  std::vector<CachedPlaneState>().swap(cached_layout_);
+  test_verdicts_.Clear();
+}
+
+uint64_t DisplayPlaneManager::GetLayerStackSignature(
+    const std::vector<OverlayLayer> &layers) const {
+  uint64_t signature = HashCombine(plane_set_signature_, layers.size());
+  for (const OverlayLayer &layer : layers) {
+    const OverlayBuffer *buffer = layer.GetBuffer();
+    const HwcRect<int> &display_frame = layer.GetDisplayFrame();
+    const HwcRect<float> &source_crop = layer.GetSourceCrop();
+    // Cursor moves don't change which plane the cursor ends up on.
+    if (buffer->GetUsage() & kLayerCursor) {
+      signature = HashCombine(signature, layer.GetDisplayFrameWidth());
+      signature = HashCombine(signature, layer.GetDisplayFrameHeight());
+    } else {
+      signature = HashCombine(signature, display_frame.left);
+      signature = HashCombine(signature, display_frame.top);
+      signature = HashCombine(signature, display_frame.right);
+      signature = HashCombine(signature, display_frame.bottom);
+    }
+    signature = HashCombine(signature, static_cast<int>(source_crop.left));
+    signature = HashCombine(signature, static_cast<int>(source_crop.top));
+    signature = HashCombine(signature, static_cast<int>(source_crop.right));
+    signature = HashCombine(signature, static_cast<int>(source_crop.bottom));
+    signature = HashCombine(signature, layer.GetTransform());
+    signature = HashCombine(signature, layer.GetAlpha());
+    signature =
+        HashCombine(signature, static_cast<int32_t>(layer.GetBlending()));
+    signature = HashCombine(signature, buffer->GetFormat());
+    signature = HashCombine(signature, buffer->GetWidth());
+    signature = HashCombine(signature, buffer->GetHeight());
+    signature = HashCombine(signature, buffer->GetUsage());
+  }
+
+  return signature;
+}
+
+void DisplayPlaneManager::CacheLayout(uint64_t signature,
+                                      const DisplayPlaneStateList &composition,
+                                      uint64_t test_commits) {
+  cached_layout_.clear();
+  for (const DisplayPlaneState &plane : composition) {
+    cached_layout_.emplace_back();
+    CachedPlaneState &cached = cached_layout_.back();
+    cached.plane = plane.plane();
+    cached.state = plane.GetCompositionState();
+    cached.source_layers = plane.source_layers();
+  }
+
+  cached_signature_ = signature;
+  cached_test_commits_ = test_commits;
+  cached_layout_valid_ = true;
+}
+
+bool DisplayPlaneManager::ApplyCachedLayout(std::vector<OverlayLayer> &layers,
+                                            DisplayPlaneStateList &composition,
+                                            bool *render_layers) {
+  // Buffers seen for the first time have no framebuffer yet, make sure the
+  // ones we scan out directly get one before touching any state.
+  for (const CachedPlaneState &cached : cached_layout_) {
+    if (cached.state != DisplayPlaneState::State::kScanout)
+      continue;
+
+    OverlayBuffer *buffer = layers.at(cached.source_layers.front()).GetBuffer();
+    if (buffer->GetFb() == 0 && !buffer->CreateFrameBuffer(gpu_fd_)) {
+      InvalidateValidationCache();
+      return false;
+    }
+  }
+
+  for (const CachedPlaneState &cached : cached_layout_) {
+    OverlayLayer *layer = &layers.at(cached.source_layers.front());
+    composition.emplace_back().Reset(cached.plane, layer, layer->GetIndex());
+    if (cached.state != DisplayPlaneState::State::kRender)
+      continue;
+
+    DisplayPlaneState &last_plane = composition.back();
+    last_plane.ForceGPURendering();
+    size_t size = cached.source_layers.size();
+    for (size_t i = 1; i < size; i++) {
+      const OverlayLayer &source = layers.at(cached.source_layers.at(i));
+      last_plane.AddLayer(source.GetIndex(), source.GetDisplayFrame());
+    }
+
+    EnsureOffScreenTarget(last_plane);
+    *render_layers = true;
+  }
+
+  for (auto &fb : in_flight_surfaces_) {
+    fb->ResetInFlightMode();
+  }
+
+  return true;
+}
+
+void DisplayPlaneManager::ReuseOffScreenTargets(
+    const std::vector<OverlayLayer> &layers,
+    DisplayPlaneStateList &composition) {
+  // Layers on planes below a render plane punch holes into it, so the
+  // signature of each render plane covers every plane up to it.
+  uint64_t signature = 0;
+  for (DisplayPlaneState &plane : composition) {
+    bool render = plane.GetCompositionState() ==
+                  DisplayPlaneState::State::kRender;
+    bool unchanged = true;
+    signature = HashCombine(signature, plane.plane()->id());
+    signature = HashCombine(signature, render);
+    for (size_t index : plane.source_layers()) {
+      const OverlayLayer &layer = layers.at(index);
+      signature = HashCombine(signature, index);
+      for (int i = 0; i < 4; i++)
+        signature = HashCombine(signature, layer.GetDisplayFrame().bounds[i]);
+
+      if (!render)
+        continue;
+
+      const HwcRect<float> &source_crop = layer.GetSourceCrop();
+      for (int i = 0; i < 4; i++)
+        signature = HashCombine(signature, source_crop.bounds[i] * 16.0f);
+
+      signature = HashCombine(signature, layer.GetTransform());
+      signature = HashCombine(signature, layer.GetAlpha());
+      signature = HashCombine(signature,
+                              static_cast<int32_t>(layer.GetBlending()));
+      // Clients don't have to report a new buffer as damage, the buffer
+      // itself has to be the same. Buffers are cached per import, so
+      // their id only changes with the buffer.
+      signature = HashCombine(signature, layer.GetBuffer()->GetId());
+      const HwcRect<int> &damage = layer.GetSurfaceDamage();
+      if (damage.right > damage.left && damage.bottom > damage.top)
+        unchanged = false;
+    }
+
+    if (!render || !plane.GetOffScreenTarget())
+      continue;
+
+    for (const RenderTarget &target : displayed_targets_) {
+      if (!unchanged || target.plane != plane.plane() ||
+          target.signature != signature)
+        continue;
+
+      // Show the surface from the last frame again. It is added back to
+      // the in flight surfaces, which keeps the pool from recycling it.
+      NativeSurface *surface = plane.GetOffScreenTarget();
+      if (surface != target.surface) {
+        auto it = std::find(in_flight_surfaces_.begin(),
+                            in_flight_surfaces_.end(), surface);
+        if (it != in_flight_surfaces_.end())
+          in_flight_surfaces_.erase(it);
+
+        surface->ResetInFlightMode();
+        surface = target.surface;
+        surface->SetPlaneTarget(plane, gpu_fd_);
+        surface->ResetInFlightMode();
+        plane.SetOffScreenTarget(surface);
+        in_flight_surfaces_.emplace_back(surface);
+      }
+
+      plane.SetOffScreenTargetValid(true);
+      break;
+    }
+
+    in_flight_targets_.emplace_back(
+        RenderTarget{plane.plane(), plane.GetOffScreenTarget(), signature});
+  }
 }
 
 std::unique_ptr<DisplayPlane> DisplayPlaneManager::CreatePlane(
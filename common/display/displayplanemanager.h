@@ -24,17 +24,22 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <drmscopedtypes.h>
 #include <hwcbuffer.h>
+#include <hwcdefs.h>
 #include <scopedfd.h>
 
 #include "nativesync.h"
 
 #include "displayplanestate.h"
+#include "lrucache.h"
+#include "planeallocationstrategy.h"
 
 namespace hwcomposer {
 
 class DisplayPlane;
 class DisplayPlaneState;
+class DrmPropertyRegistry;
 class GpuDevice;
 class NativeBufferHandler;
 class OverlayBuffer;
@@ -46,24 +51,59 @@ class DisplayPlaneManager {
 
   virtual ~DisplayPlaneManager();
 
-  bool Initialize(NativeBufferHandler *buffer_handler, uint32_t width,
+  bool Initialize(NativeBufferHandler *buffer_handler,
+                  DrmPropertyRegistry *property_registry, uint32_t width,
                   uint32_t height);
 
   bool BeginFrameUpdate(std::vector<OverlayLayer> &layers);
-  std::tuple<bool, DisplayPlaneStateList> ValidateLayers(
-      std::vector<OverlayLayer> &layers, bool pending_modeset);
+  // Fills |composition| with the planes to use for |layers|. Returns true
+  // if any of them needs to be composited by GPU.
+  bool ValidateLayers(std::vector<OverlayLayer> &layers, bool pending_modeset,
+                      DisplayPlaneStateList &composition);
 
   bool CommitFrame(DisplayPlaneStateList &planes,
                    drmModeAtomicReqPtr property_set, bool needs_modeset,
-                   std::unique_ptr<NativeSync> &sync_object, ScopedFd &fence);
+                   NativeSync *sync_object, ScopedFd &fence);
 
   void DisablePipe(drmModeAtomicReqPtr property_set);
 
+  // Moves the cursor plane of the last committed frame with an atomic
+  // commit which touches nothing but its position. Returns 0 on success,
+  // -EBUSY while the previous commit is still pending and -EINVAL if the
+  // cursor isn't scanned out from the cursor plane.
+  int UpdateCursorPosition(int32_t x, int32_t y);
+
   void EndFrameUpdate();
 
+  // Drops the plane layout remembered from the previous frame and all
+  // cached test commit results. Needs to be called whenever the state of
+  // the pipe changes behind our back (i.e. modeset or DPMS).
+  void InvalidateValidationCache();
+
+  struct ValidationStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t test_commits = 0;
+    uint64_t test_commits_saved = 0;
+    uint64_t verdict_hits = 0;
+    uint64_t verdict_misses = 0;
+    // Test commits issued while validating the last frame.
+    uint64_t last_frame_test_commits = 0;
+  };
+
+  const ValidationStats &GetValidationStats() const {
+    return validation_stats_;
+  }
+
+  // Selects the algorithm used by ValidateLayers.
+  void SetAllocationStrategy(HWCPlaneAllocation allocation);
+
+  const PlaneAllocationStrategy *GetAllocationStrategy() const {
+    return allocation_strategy_.get();
+  }
+
  protected:
   struct OverlayPlane {
-   public:
     OverlayPlane(DisplayPlane *plane, OverlayLayer *layer)
         : plane(plane), layer(layer) {
     }
@@ -75,12 +115,64 @@ class DisplayPlaneManager {
                                                     uint32_t possible_crtcs);
   virtual bool TestCommit(const std::vector<OverlayPlane> &commit_planes) const;
 
-  bool FallbacktoGPU(DisplayPlane *target_plane, OverlayLayer *layer,
-                     const std::vector<OverlayPlane> &commit_planes) const;
+  uint64_t GetLayerStackSignature(
+      const std::vector<OverlayLayer> &layers) const;
+  void CacheLayout(uint64_t signature, const DisplayPlaneStateList &composition,
+                   uint64_t test_commits);
+  // Makes the next commit carry every plane property instead of only the
+  // ones which changed since the last commit.
+  void InvalidateCommittedProperties();
+  bool ApplyCachedLayout(std::vector<OverlayLayer> &layers,
+                         DisplayPlaneStateList &composition,
+                         bool *render_layers);
+  // Hands render planes whose inputs did not change since the last commit
+  // the offscreen target they were shown with, so the compositor can skip
+  // them.
+  void ReuseOffScreenTargets(const std::vector<OverlayLayer> &layers,
+                             DisplayPlaneStateList &composition);
+  // Returns the buffer (and framebuffer, if one was created) used for |bo|
+  // in a recent frame or a new one. Sets |key| to its buffer_cache_ key, 0
+  // if it isn't cached.
+  std::shared_ptr<OverlayBuffer> GetOverlayBuffer(const HwcBuffer &bo,
+                                                  uint64_t *key);
+  // Forgets the least recently used buffers while there are more than
+  // kMaxCachedBuffers. Buffers still scanned out stay alive through
+  // displayed_buffers_.
+  void TrimBufferCache();
+  // Forgets buffers which were destroyed since the last frame, see
+  // BufferImportLog.
+  void DropReleasedBuffers();
+  // Blocks until the next vblank of the pipe.
+  void WaitForVBlank() const;
 
-  void EnsureOffScreenTarget(DisplayPlaneState &plane);
-  void ValidateFinalLayers(DisplayPlaneStateList &list,
-                           std::vector<OverlayLayer> &layers);
+  // Plane assignment which was validated for a given layer stack.
+  struct CachedPlaneState {
+    DisplayPlane *plane;
+    DisplayPlaneState::State state;
+    std::vector<size_t> source_layers;
+  };
+
+  // Buffer seen in a recent frame, keyed on its import id. GEM handles
+  // can't be used, the kernel hands them out again once a buffer is freed.
+  struct CachedBuffer {
+    std::shared_ptr<OverlayBuffer> buffer;
+    uint64_t last_used_frame;
+  };
+
+  // Buffer a layer showed in the previous frame. A layer still showing the
+  // same import keeps it without looking it up in buffer_cache_ again.
+  struct LayerBuffer {
+    uint64_t key;
+    std::shared_ptr<OverlayBuffer> buffer;
+  };
+
+  // Offscreen target of a render plane and a signature of the layers it
+  // was composited from.
+  struct RenderTarget {
+    DisplayPlane *plane;
+    NativeSurface *surface;
+    uint64_t signature;
+  };
 
   NativeBufferHandler *buffer_handler_;
   std::vector<std::unique_ptr<NativeSurface>> surfaces_;
@@ -88,15 +180,137 @@ class DisplayPlaneManager {
   std::unique_ptr<DisplayPlane> primary_plane_;
   std::unique_ptr<DisplayPlane> cursor_plane_;
   std::vector<std::unique_ptr<DisplayPlane>> overlay_planes_;
-  std::vector<std::unique_ptr<OverlayBuffer>> in_flight_buffers_;
-  std::vector<std::unique_ptr<OverlayBuffer>> displayed_buffers_;
-  std::unique_ptr<NativeSync> current_sync_;
+  std::vector<std::shared_ptr<OverlayBuffer>> in_flight_buffers_;
+  std::vector<std::shared_ptr<OverlayBuffer>> displayed_buffers_;
+  std::map<uint64_t, CachedBuffer> buffer_cache_;
+  std::vector<uint64_t> released_imports_;
+  uint64_t release_log_position_ = 0;
+  std::vector<LayerBuffer> layer_buffers_;
+  uint64_t frame_ = 0;
+  // Atomic requests reused across test commits and cursor moves.
+  mutable ScopedDrmAtomicReqPtr test_pset_;
+  ScopedDrmAtomicReqPtr cursor_pset_;
+  std::vector<CachedPlaneState> cached_layout_;
+  std::vector<RenderTarget> in_flight_targets_;
+  std::vector<RenderTarget> displayed_targets_;
+  uint64_t cached_signature_ = 0;
+  uint64_t cached_test_commits_ = 0;
+  uint64_t plane_set_signature_ = 0;
+  bool cached_layout_valid_ = false;
+  // Cursor plane is enabled in the last successful commit.
+  bool cursor_committed_ = false;
+  std::unique_ptr<PlaneAllocationStrategy> allocation_strategy_;
+  mutable ValidationStats validation_stats_;
+  mutable LRUCache<uint64_t, bool> test_verdicts_;
 
   uint32_t width_;
   uint32_t height_;
   uint32_t crtc_id_;
   uint32_t pipe_;
   uint32_t gpu_fd_;
+
+ private:
+  // Used by PlaneAllocationStrategy implementations only, through
+  // PlaneAllocationContext.
+  friend class PlaneAllocationContext;
+
+  // Same as TestCommit, but answers repeated probes of small plane
+  // combinations from test_verdicts_.
+  bool TestCommitCached(const std::vector<OverlayPlane> &commit_planes) const;
+
+  bool FallbacktoGPU(DisplayPlane *target_plane, OverlayLayer *layer,
+                     const std::vector<OverlayPlane> &commit_planes) const;
+  bool CanScanout(DisplayPlane *target_plane, OverlayLayer *layer) const;
+
+  void EnsureOffScreenTarget(DisplayPlaneState &plane);
+  void ValidateFinalLayers(DisplayPlaneStateList &list,
+                           std::vector<OverlayLayer> &layers);
+  void ComposeAllLayersOnPrimary(std::vector<OverlayLayer> &layers,
+                                 DisplayPlaneStateList &composition);
+
+  // Assigns primary and overlay planes in order, the plane i takes layers
+  // starting at starts[i] up to the next start (or layers_end). Cursor
+  // layer, if any, goes to the cursor plane.
+  bool BuildComposition(std::vector<OverlayLayer> &layers,
+                        const std::vector<size_t> &starts, size_t layers_end,
+                        OverlayLayer *cursor_layer,
+                        DisplayPlaneStateList &composition);
+
+  // Offscreen targets handed out by EnsureOffScreenTarget are kept aside
+  // until validation is done. ReleaseOffScreenTargets gives them back
+  // when a composition is thrown away, ResetInFlightTargets once the
+  // final composition is known.
+  void ReleaseOffScreenTargets();
+  void ResetInFlightTargets();
+};
+
+// What PlaneAllocationStrategy implementations may use of the
+// DisplayPlaneManager they allocate planes for.
+class PlaneAllocationContext {
+ public:
+  typedef DisplayPlaneManager::OverlayPlane OverlayPlane;
+
+  explicit PlaneAllocationContext(DisplayPlaneManager &manager)
+      : manager_(manager) {
+  }
+
+  DisplayPlane *GetPrimaryPlane() const {
+    return manager_.primary_plane_.get();
+  }
+
+  DisplayPlane *GetCursorPlane() const {
+    return manager_.cursor_plane_.get();
+  }
+
+  const std::vector<std::unique_ptr<DisplayPlane>> &GetOverlayPlanes() const {
+    return manager_.overlay_planes_;
+  }
+
+  bool TestCommitCached(const std::vector<OverlayPlane> &commit_planes) const {
+    return manager_.TestCommitCached(commit_planes);
+  }
+
+  bool FallbacktoGPU(DisplayPlane *target_plane, OverlayLayer *layer,
+                     const std::vector<OverlayPlane> &commit_planes) const {
+    return manager_.FallbacktoGPU(target_plane, layer, commit_planes);
+  }
+
+  bool CanScanout(DisplayPlane *target_plane, OverlayLayer *layer) const {
+    return manager_.CanScanout(target_plane, layer);
+  }
+
+  void EnsureOffScreenTarget(DisplayPlaneState &plane) {
+    manager_.EnsureOffScreenTarget(plane);
+  }
+
+  void ValidateFinalLayers(DisplayPlaneStateList &list,
+                           std::vector<OverlayLayer> &layers) {
+    manager_.ValidateFinalLayers(list, layers);
+  }
+
+  void ComposeAllLayersOnPrimary(std::vector<OverlayLayer> &layers,
+                                 DisplayPlaneStateList &composition) {
+    manager_.ComposeAllLayersOnPrimary(layers, composition);
+  }
+
+  bool BuildComposition(std::vector<OverlayLayer> &layers,
+                        const std::vector<size_t> &starts, size_t layers_end,
+                        OverlayLayer *cursor_layer,
+                        DisplayPlaneStateList &composition) {
+    return manager_.BuildComposition(layers, starts, layers_end, cursor_layer,
+                                     composition);
+  }
+
+  void ReleaseOffScreenTargets() {
+    manager_.ReleaseOffScreenTargets();
+  }
+
+  void ResetInFlightTargets() {
+    manager_.ResetInFlightTargets();
+  }
+
+ private:
+  DisplayPlaneManager &manager_;
 };
 
 }  // namespace hwcomposer
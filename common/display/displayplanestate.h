@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <vector>
 
+#include "framevector.h"
 #include "overlaylayer.h"
 
 namespace hwcomposer {
@@ -28,7 +29,9 @@ class DisplayPlaneState;
 class NativeSurface;
 struct OverlayLayer;
 
-typedef std::vector<DisplayPlaneState> DisplayPlaneStateList;
+// Kept across frames, so the source layer lists of its planes keep their
+// storage. Planes handed out by emplace_back() are set up with Reset().
+typedef FrameVector<DisplayPlaneState> DisplayPlaneStateList;
 
 class DisplayPlaneState {
  public:
@@ -37,10 +40,18 @@ class DisplayPlaneState {
   DisplayPlaneState() = default;
   DisplayPlaneState(DisplayPlaneState &&rhs) = default;
   DisplayPlaneState &operator=(DisplayPlaneState &&other) = default;
-  DisplayPlaneState(DisplayPlane *plane, OverlayLayer *layer, uint32_t index)
-      : plane_(plane), layer_(layer) {
-    source_layers_.emplace_back(index);
+
+  // Makes this the plane |layer| is scanned out from, dropping whatever it
+  // held in an earlier frame.
+  void Reset(DisplayPlane *plane, OverlayLayer *layer, uint32_t index) {
+    state_ = State::kScanout;
+    plane_ = plane;
+    layer_ = layer;
+    offscreen_target_ = NULL;
+    offscreen_target_valid_ = false;
     display_frame_ = layer->GetDisplayFrame();
+    source_layers_.clear();
+    source_layers_.emplace_back(index);
   }
 
   State GetCompositionState() const {
@@ -92,6 +103,17 @@ class DisplayPlaneState {
     return offscreen_target_;
   }
 
+  // Set when the offscreen target still holds the composited result of
+  // exactly these source layers from the previous frame and does not need
+  // to be redrawn.
+  void SetOffScreenTargetValid(bool valid) {
+    offscreen_target_valid_ = valid;
+  }
+
+  bool IsOffScreenTargetValid() const {
+    return offscreen_target_valid_;
+  }
+
   DisplayPlane *plane() const {
     return plane_;
   }
@@ -105,6 +127,7 @@ class DisplayPlaneState {
   DisplayPlane *plane_ = NULL;
   OverlayLayer *layer_ = NULL;
   NativeSurface *offscreen_target_ = NULL;
+  bool offscreen_target_valid_ = false;
   HwcRect<int> display_frame_;
   std::vector<size_t> source_layers_;
 };
@@ -0,0 +1,120 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+#include "drmpropertyregistry.h"
+
+#include <xf86drmMode.h>
+
+#include <hwctrace.h>
+
+#include <drmscopedtypes.h>
+
+namespace hwcomposer {
+
+DrmPropertyRegistry::DrmPropertyRegistry(uint32_t gpu_fd) : gpu_fd_(gpu_fd) {
+}
+
+bool DrmPropertyRegistry::GetProperty(uint32_t object_id,
+                                      uint32_t object_type, const char *name,
+                                      Property *property) {
+  ScopedSpinLock lock(spin_lock_);
+  const std::map<std::string, Property> *object =
+      GetObject(object_id, object_type);
+  if (!object)
+    return false;
+
+  auto it = object->find(name);
+  if (it == object->end())
+    return false;
+
+  *property = it->second;
+  return true;
+}
+
+bool DrmPropertyRegistry::GetPropertyId(uint32_t object_id,
+                                        uint32_t object_type,
+                                        const char *name, uint32_t *id) {
+  Property property;
+  if (!GetProperty(object_id, object_type, name, &property))
+    return false;
+
+  *id = property.id;
+  return true;
+}
+
+void DrmPropertyRegistry::InvalidateObject(uint32_t object_id) {
+  ScopedSpinLock lock(spin_lock_);
+  objects_.erase(object_id);
+}
+
+const DrmPropertyRegistry::PropertyInfo *DrmPropertyRegistry::GetPropertyInfo(
+    uint32_t property_id) {
+  auto it = properties_.find(property_id);
+  if (it != properties_.end())
+    return &it->second;
+
+  queries_++;
+  ScopedDrmPropertyPtr property(drmModeGetProperty(gpu_fd_, property_id));
+  if (!property) {
+    ETRACE("Unable to get property %d.", property_id);
+    return NULL;
+  }
+
+  PropertyInfo &info = properties_[property_id];
+  info.flags = property->flags;
+  info.name = property->name;
+  if (property->flags & (DRM_MODE_PROP_ENUM | DRM_MODE_PROP_BITMASK)) {
+    for (int i = 0; i < property->count_enums; i++)
+      info.enums[property->enums[i].name] = property->enums[i].value;
+  }
+
+  return &info;
+}
+
+const std::map<std::string, DrmPropertyRegistry::Property> *
+DrmPropertyRegistry::GetObject(uint32_t object_id, uint32_t object_type) {
+  auto it = objects_.find(object_id);
+  if (it != objects_.end())
+    return &it->second;
+
+  queries_++;
+  ScopedDrmObjectPropertyPtr object_properties(
+      drmModeObjectGetProperties(gpu_fd_, object_id, object_type));
+  if (!object_properties) {
+    ETRACE("Unable to get properties of object %d.", object_id);
+    return NULL;
+  }
+
+  std::map<std::string, Property> &object = objects_[object_id];
+  uint32_t count_props = object_properties->count_props;
+  for (uint32_t i = 0; i < count_props; i++) {
+    const PropertyInfo *info = GetPropertyInfo(object_properties->props[i]);
+    if (!info)
+      continue;
+
+    Property &property = object[info->name];
+    property.id = object_properties->props[i];
+    property.flags = info->flags;
+    property.value = object_properties->prop_values[i];
+    if (!info->enums.empty())
+      property.enums = &info->enums;
+  }
+
+  return &object;
+}
+
+}  // namespace hwcomposer
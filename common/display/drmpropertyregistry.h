@@ -0,0 +1,86 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+#ifndef DRM_PROPERTY_REGISTRY_H_
+#define DRM_PROPERTY_REGISTRY_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include <spinlock.h>
+
+namespace hwcomposer {
+
+// Caches the DRM properties of KMS objects. The property list of an
+// object and the description of a property are each fetched once, so
+// looking up any number of properties on any number of planes, CRTCs and
+// connectors does not cost more than a couple of ioctls per object.
+// Property descriptions are shared by all objects exposing them.
+class DrmPropertyRegistry {
+ public:
+  struct Property {
+    uint32_t id = 0;
+    // DRM_MODE_PROP_* flags.
+    uint32_t flags = 0;
+    // Value at the time the object was first looked up.
+    uint64_t value = 0;
+    // Enum and bitmask entries by name, NULL for other property types.
+    const std::map<std::string, uint64_t> *enums = NULL;
+  };
+
+  explicit DrmPropertyRegistry(uint32_t gpu_fd);
+  DrmPropertyRegistry(const DrmPropertyRegistry &rhs) = delete;
+  DrmPropertyRegistry &operator=(const DrmPropertyRegistry &rhs) = delete;
+
+  // Returns false if |object_id| has no property called |name|.
+  bool GetProperty(uint32_t object_id, uint32_t object_type, const char *name,
+                   Property *property);
+
+  bool GetPropertyId(uint32_t object_id, uint32_t object_type,
+                     const char *name, uint32_t *id);
+
+  // Forgets the property list of |object_id|, e.g. when a connector may
+  // have been replaced on hotplug. Property descriptions are kept.
+  void InvalidateObject(uint32_t object_id);
+
+  // Number of ioctls issued so far.
+  uint64_t GetQueryCount() const {
+    return queries_;
+  }
+
+ private:
+  struct PropertyInfo {
+    uint32_t flags = 0;
+    std::string name;
+    std::map<std::string, uint64_t> enums;
+  };
+
+  const PropertyInfo *GetPropertyInfo(uint32_t property_id);
+  const std::map<std::string, Property> *GetObject(uint32_t object_id,
+                                                    uint32_t object_type);
+
+  uint32_t gpu_fd_;
+  uint64_t queries_ = 0;
+  std::map<uint32_t, PropertyInfo> properties_;
+  std::map<uint32_t, std::map<std::string, Property>> objects_;
+  SpinLock spin_lock_;
+};
+
+}  // namespace hwcomposer
+#endif  // DRM_PROPERTY_REGISTRY_H_
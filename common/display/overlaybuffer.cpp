@@ -21,6 +21,8 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#include <atomic>
+
 #include <hwcdefs.h>
 #include <nativebufferhandler.h>
 
@@ -28,16 +30,22 @@
 
 namespace hwcomposer {
 
+OverlayBuffer::OverlayBuffer() {
+  static std::atomic<uint64_t> next_id(1);
+  id_ = next_id++;
+}
+
 OverlayBuffer::~OverlayBuffer() {
   if (fb_id_ && drmModeRmFB(gpu_fd_, fb_id_))
     ETRACE("Failed to remove fb %s", PRINTERROR());
-#ifdef USE_MINIGBM
-  if (prime_fd_)
-    close(prime_fd_);
-#endif
 }
 
 void OverlayBuffer::Initialize(const HwcBuffer& bo) {
+  if (!bo.owns_prime_fd)
+    owned_prime_fd_.Close();
+  else if (owned_prime_fd_.get() != static_cast<int>(bo.prime_fd))
+    owned_prime_fd_.Reset(bo.prime_fd);
+
   width_ = bo.width;
   height_ = bo.height;
   for (uint32_t i = 0; i < 4; i++) {
@@ -49,6 +57,7 @@ void OverlayBuffer::Initialize(const HwcBuffer& bo) {
   SetRecommendedFormat(bo.format);
   prime_fd_ = bo.prime_fd;
   usage_ = bo.usage;
+  import_id_ = bo.import_id;
 }
 
 void OverlayBuffer::InitializeFromNativeHandle(
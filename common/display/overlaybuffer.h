@@ -19,6 +19,7 @@
 #include <platformdefines.h>
 
 #include <hwcbuffer.h>
+#include <scopedfd.h>
 
 #include "compositordefs.h"
 
@@ -28,7 +29,7 @@ class NativeBufferHandler;
 
 class OverlayBuffer {
  public:
-  OverlayBuffer() = default;
+  OverlayBuffer();
   OverlayBuffer(OverlayBuffer&& rhs) = default;
   OverlayBuffer& operator=(OverlayBuffer&& other) = default;
 
@@ -63,6 +64,17 @@ class OverlayBuffer {
     return fb_id_;
   }
 
+  // Unique for the lifetime of the process, lets GPU resources created for
+  // this buffer be found again in later frames.
+  uint64_t GetId() const {
+    return id_;
+  }
+
+  // Import id of the buffer handler, 0 if the import was not cached.
+  uint64_t GetImportId() const {
+    return import_id_;
+  }
+
   GpuImage ImportImage(GpuDisplay egl_display);
 
   bool CreateFrameBuffer(uint32_t gpu_fd);
@@ -72,6 +84,8 @@ class OverlayBuffer {
   void Dump();
 
  private:
+  uint64_t id_;
+  uint64_t import_id_ = 0;
   uint32_t width_ = 0;
   uint32_t height_ = 0;
   uint32_t format_ = 0;
@@ -83,6 +97,8 @@ class OverlayBuffer {
   uint32_t usage_ = 0;
   uint32_t ref_count_ = 1;
   uint32_t gpu_fd_;
+  // prime_fd_, if the import left it to us to close it.
+  ScopedFd owned_prime_fd_;
   bool is_yuv_ = false;
   HWCNativeHandle handle_ = 0;
   NativeBufferHandler* buffer_handler_ = NULL;
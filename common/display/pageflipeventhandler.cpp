@@ -61,13 +61,32 @@ int PageFlipEventHandler::VSyncControl(bool enabled) {
   if (enabled_ == enabled)
     return 0;
 
-  ScopedSpinLock lock(spin_lock_);
+  spin_lock_.lock();
   enabled_ = enabled;
   last_timestamp_ = -1;
+  spin_lock_.unlock();
+  wake_.notify_one();
 
   return 0;
 }
 
+void PageFlipEventHandler::SetVBlankCallback(std::function<void()> callback) {
+  ScopedSpinLock lock(spin_lock_);
+  vblank_callback_ = callback;
+}
+
+void PageFlipEventHandler::RequestVBlankCallback() {
+  spin_lock_.lock();
+  vblank_callback_requested_ = true;
+  spin_lock_.unlock();
+  wake_.notify_one();
+
+  if (!InitWorker("PageFlipEventHandler")) {
+    ETRACE("Failed to initalize thread for PageFlipEventHandler. %s",
+           PRINTERROR());
+  }
+}
+
 void PageFlipEventHandler::HandlePageFlipEvent(unsigned int sec,
                                                unsigned int usec) {
   ScopedSpinLock lock(spin_lock_);
@@ -86,16 +105,18 @@ void PageFlipEventHandler::HandlePageFlipEvent(unsigned int sec,
 
 void PageFlipEventHandler::Routine() {
   spin_lock_.lock();
+  while (!enabled_ && !vblank_callback_requested_)
+    wake_.wait(spin_lock_);
 
-  bool enabled = enabled_;
+  // Requests made from here on need another vblank.
+  bool run_vblank_callback = vblank_callback_requested_;
+  vblank_callback_requested_ = false;
+  std::function<void()> vblank_callback = vblank_callback_;
   int fd = fd_;
   int pipe = pipe_;
 
   spin_lock_.unlock();
 
-  if (!enabled)
-    return;
-
   uint32_t high_crtc = (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
 
   drmVBlank vblank;
@@ -105,6 +126,11 @@ void PageFlipEventHandler::Routine() {
   vblank.request.sequence = 1;
 
   int ret = drmWaitVBlank(fd, &vblank);
+  // Runs even if the wait failed, i.e. the pipe was turned off, so the
+  // requester finds out.
+  if (run_vblank_callback && vblank_callback)
+    vblank_callback();
+
   if (!ret)
     HandlePageFlipEvent(vblank.reply.tval_sec, (int64_t)vblank.reply.tval_usec);
 }
@@ -19,6 +19,9 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <functional>
+
 #include <nativedisplay.h>
 
 #include "hwcthread.h"
@@ -40,6 +43,13 @@ class PageFlipEventHandler : public HWCThread {
 
   int VSyncControl(bool enabled);
 
+  // |callback| runs on the event thread after each vblank asked for with
+  // RequestVBlankCallback(), whether vsync events are enabled or not. It
+  // applies state which is coalesced until the display refreshes.
+  void SetVBlankCallback(std::function<void()> callback);
+
+  void RequestVBlankCallback();
+
  protected:
   void Routine() override;
 
@@ -48,9 +58,14 @@ class PageFlipEventHandler : public HWCThread {
   // actually call the hook) and we don't want the memory freed until we're
   // done
   std::shared_ptr<VsyncCallback> callback_ = NULL;
+  std::function<void()> vblank_callback_;
   SpinLock spin_lock_;
+  // Wakes the event thread, which sleeps while there is nothing to wait
+  // for.
+  std::condition_variable_any wake_;
   uint32_t display_;
-  bool enabled_;
+  bool enabled_ = false;
+  bool vblank_callback_requested_ = false;
 
   float refresh_;
   int fd_;
@@ -0,0 +1,543 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "planeallocationstrategy.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include <overlaylayer.h>
+
+#include "displayplane.h"
+#include "displayplanemanager.h"
+#include "hwctrace.h"
+#include "overlaybuffer.h"
+#include "planecostmodel.h"
+
+namespace hwcomposer {
+
+typedef PlaneAllocationContext::OverlayPlane OverlayPlane;
+
+// Upper bound of plane assignments ExhaustiveAllocationStrategy ranks
+// before giving up on searching all of them.
+static const size_t kMaxExhaustiveConfigurations = 256;
+
+static int64_t GetLayerSavings(const OverlayLayer &layer) {
+  PlaneCostInput input;
+  input.display_frame = layer.GetDisplayFrame();
+  input.source_crop = layer.GetSourceCrop();
+  input.format = layer.GetBuffer()->GetFormat();
+  input.alpha = layer.GetAlpha();
+  input.blending = layer.GetBlending();
+  return PlaneCostModel::GetOverlaySavings(input);
+}
+
+// Returns the topmost layer if it is a cursor and there is anything below
+// it.
+static OverlayLayer *GetCursorLayer(std::vector<OverlayLayer> &layers) {
+  if (layers.size() > 1 &&
+      (layers.back().GetBuffer()->GetUsage() & kLayerCursor))
+    return &layers.back();
+
+  return NULL;
+}
+
+static DisplayPlane *GetPlane(const PlaneAllocationContext &context,
+                              size_t index) {
+  if (index == 0)
+    return context.GetPrimaryPlane();
+
+  return context.GetOverlayPlanes().at(index - 1).get();
+}
+
+void PlaneAllocationStrategy::UpdateStats(uint64_t test_commits,
+                                          uint64_t decision_time_us) {
+  stats_.frames++;
+  stats_.test_commits += test_commits;
+  stats_.decision_time_us += decision_time_us;
+  stats_.last_test_commits = test_commits;
+  stats_.last_decision_time_us = decision_time_us;
+}
+
+std::unique_ptr<PlaneAllocationStrategy> CreatePlaneAllocationStrategy(
+    HWCPlaneAllocation allocation) {
+  switch (allocation) {
+    case HWCPlaneAllocation::kWholeConfig:
+      return std::unique_ptr<PlaneAllocationStrategy>(
+          new WholeConfigAllocationStrategy());
+    case HWCPlaneAllocation::kCostBased:
+      return std::unique_ptr<PlaneAllocationStrategy>(
+          new CostBasedAllocationStrategy());
+    case HWCPlaneAllocation::kExhaustive:
+      return std::unique_ptr<PlaneAllocationStrategy>(
+          new ExhaustiveAllocationStrategy());
+    default:
+      break;
+  }
+
+  return std::unique_ptr<PlaneAllocationStrategy>(
+      new GreedyAllocationStrategy());
+}
+
+bool GreedyAllocationStrategy::Allocate(PlaneAllocationContext &context,
+                                        std::vector<OverlayLayer> &layers,
+                                        bool pending_modeset,
+                                        DisplayPlaneStateList &composition) {
+  std::vector<OverlayPlane> commit_planes;
+  OverlayLayer *cursor_layer = NULL;
+  auto layer_begin = layers.begin();
+  auto layer_end = layers.end();
+  bool render_layers = false;
+  // We start off with Primary plane.
+  DisplayPlane *current_plane = context.GetPrimaryPlane();
+
+  OverlayLayer *primary_layer = &(*(layers.begin()));
+  commit_planes.emplace_back(OverlayPlane(current_plane, primary_layer));
+  composition.emplace_back().Reset(current_plane, primary_layer,
+                                   primary_layer->GetIndex());
+  ++layer_begin;
+  // Lets ensure we fall back to GPU composition in case
+  // primary layer cannot be scanned out directly.
+  if ((pending_modeset && layers.size() > 1) ||
+      context.FallbacktoGPU(current_plane, primary_layer, commit_planes)) {
+    DisplayPlaneState &last_plane = composition.back();
+    render_layers = true;
+    // Case where we have just one layer which needs to be composited using
+    // GPU.
+    last_plane.ForceGPURendering();
+
+    for (auto i = layer_begin; i != layer_end; ++i) {
+      last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
+    }
+
+    context.EnsureOffScreenTarget(last_plane);
+    // We need to composite primary using GPU, lets use this for
+    // all layers in this case.
+    return render_layers;
+  }
+
+  // We are just compositing Primary layer and nothing else.
+  if (layers.size() == 1) {
+    return render_layers;
+  }
+
+  // Retrieve cursor layer data and delete it from the layers.
+  for (auto j = layers.rbegin(); j != layers.rend(); ++j) {
+    if (j->GetBuffer()->GetUsage() & kLayerCursor) {
+      cursor_layer = &(*(j));
+      layer_end = std::next(j).base();
+      break;
+    }
+  }
+
+  if (layer_begin != layer_end) {
+    // Handle layers for overlay
+    uint32_t index = 0;
+    const auto &overlay_planes = context.GetOverlayPlanes();
+    for (auto j = overlay_planes.begin(); j != overlay_planes.end(); ++j) {
+      DisplayPlaneState &last_plane = composition.back();
+      // Handle remaining overlay planes.
+      for (auto i = layer_begin; i != layer_end; ++i) {
+        OverlayLayer *layer = &(*(i));
+        commit_planes.emplace_back(OverlayPlane(j->get(), layer));
+        index = i->GetIndex();
+        ++layer_begin;
+        // If we are able to composite buffer with the given plane, lets use
+        // it.
+        if (!context.FallbacktoGPU(j->get(), layer, commit_planes)) {
+          composition.emplace_back().Reset(j->get(), layer, index);
+          break;
+        } else {
+          last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
+          commit_planes.pop_back();
+        }
+      }
+
+      if (last_plane.GetCompositionState() == DisplayPlaneState::State::kRender)
+	render_layers = true;
+    }
+
+    DisplayPlaneState &last_plane = composition.back();
+    // We dont have any additional planes. Pre composite remaining layers
+    // to the last overlay plane.
+    for (auto i = layer_begin; i != layer_end; ++i) {
+      last_plane.AddLayer(i->GetIndex(), i->GetDisplayFrame());
+    }
+
+    if (last_plane.GetCompositionState() == DisplayPlaneState::State::kRender)
+      render_layers = true;
+  }
+
+  // Handle Cursor layer.
+  DisplayPlane *cursor_plane = NULL;
+  if (cursor_layer) {
+    // Handle Cursor layer. If we have dedicated cursor plane, try using it
+    // to composite cursor layer.
+    cursor_plane = context.GetCursorPlane();
+    if (cursor_plane) {
+      commit_planes.emplace_back(OverlayPlane(cursor_plane, cursor_layer));
+      // Lets ensure we fall back to GPU composition in case
+      // cursor layer cannot be scanned out directly.
+      if (context.FallbacktoGPU(cursor_plane, cursor_layer, commit_planes)) {
+        cursor_plane = NULL;
+      }
+    }
+
+    // We need to do this here to avoid compositing cursor with any previous
+    // pre-composited planes.
+    if (cursor_plane) {
+      composition.emplace_back().Reset(cursor_plane, cursor_layer,
+                                       cursor_layer->GetIndex());
+    } else {
+      DisplayPlaneState &last_plane = composition.back();
+      render_layers = true;
+      last_plane.AddLayer(cursor_layer->GetIndex(),
+                          cursor_layer->GetDisplayFrame());
+    }
+  }
+
+  if (render_layers) {
+    context.ValidateFinalLayers(composition, layers);
+  }
+
+  return render_layers;
+}
+
+bool WholeConfigAllocationStrategy::Allocate(
+    PlaneAllocationContext &context, std::vector<OverlayLayer> &layers,
+    bool pending_modeset, DisplayPlaneStateList &composition) {
+  size_t total_layers = layers.size();
+  if (pending_modeset && total_layers > 1) {
+    context.ComposeAllLayersOnPrimary(layers, composition);
+    return true;
+  }
+
+  OverlayLayer *cursor_layer = GetCursorLayer(layers);
+  size_t main_layers = cursor_layer ? total_layers - 1 : total_layers;
+  DisplayPlane *cursor_plane = context.GetCursorPlane();
+  bool cursor_on_plane = cursor_layer && cursor_plane &&
+                         context.CanScanout(cursor_plane, cursor_layer);
+  PrepareCandidates(layers, main_layers);
+
+  // Layers which failed to be scanned out directly and are composited into
+  // the plane below them.
+  std::vector<bool> demoted(main_layers, false);
+  std::vector<size_t> starts;
+  std::vector<OverlayPlane> commit_planes;
+  std::vector<OverlayPlane> probe_planes;
+  // Every iteration demotes one layer (or the cursor), so this always
+  // terminates before running out of layers.
+  for (size_t step = 0; step <= total_layers; step++) {
+    // A cursor we cannot scan out is composited with the topmost plane.
+    size_t layers_end = cursor_on_plane ? main_layers : total_layers;
+    SelectPlaneStarts(context, demoted, main_layers, layers_end, starts);
+
+    // Rule out layers the plane cannot handle at all without touching the
+    // kernel.
+    size_t planes_in_use = starts.size();
+    size_t rejected = planes_in_use;
+    for (size_t i = 0; i < planes_in_use; i++) {
+      size_t end = i + 1 < planes_in_use ? starts.at(i + 1) : layers_end;
+      if (end - starts.at(i) != 1)
+        continue;
+
+      if (!context.CanScanout(GetPlane(context, i), &layers.at(starts.at(i)))) {
+        rejected = i;
+        break;
+      }
+    }
+
+    if (rejected == 0)
+      break;
+
+    if (rejected != planes_in_use) {
+      demoted.at(starts.at(rejected)) = true;
+      continue;
+    }
+
+    bool render_layers = context.BuildComposition(
+        layers, starts, layers_end, cursor_on_plane ? cursor_layer : NULL,
+        composition);
+
+    commit_planes.clear();
+    for (DisplayPlaneState &plane : composition) {
+      commit_planes.emplace_back(
+          OverlayPlane(plane.plane(), plane.GetOverlayLayer()));
+    }
+
+    size_t planes = commit_planes.size();
+    if (context.TestCommitCached(commit_planes)) {
+      context.ResetInFlightTargets();
+      return render_layers;
+    }
+
+    // Find the first plane which makes the configuration fail. Planes
+    // below it were validated together, so it is the one to demote.
+    size_t low = 1;
+    size_t high = planes;
+    while (low < high) {
+      size_t mid = (low + high) / 2;
+      probe_planes.assign(commit_planes.begin(), commit_planes.begin() + mid);
+      if (context.TestCommitCached(probe_planes)) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+
+    size_t failed_plane = low - 1;
+    context.ReleaseOffScreenTargets();
+    composition.clear();
+    if (failed_plane == 0)
+      break;
+
+    if (cursor_on_plane && failed_plane == planes - 1) {
+      cursor_on_plane = false;
+    } else {
+      demoted.at(starts.at(failed_plane)) = true;
+    }
+  }
+
+  context.ReleaseOffScreenTargets();
+  context.ComposeAllLayersOnPrimary(layers, composition);
+  return true;
+}
+
+void WholeConfigAllocationStrategy::PrepareCandidates(
+    const std::vector<OverlayLayer> & /*layers*/, size_t /*main_layers*/) {
+}
+
+void WholeConfigAllocationStrategy::SelectPlaneStarts(
+    const PlaneAllocationContext &context, const std::vector<bool> &demoted,
+    size_t main_layers, size_t /*layers_end*/, std::vector<size_t> &starts) {
+  // Most optimistic assignment for the layers which are still allowed to
+  // be scanned out: one plane per layer in z-order, the last plane takes
+  // whatever is left.
+  size_t max_planes = context.GetOverlayPlanes().size() + 1;
+  starts.clear();
+  starts.emplace_back(0);
+  for (size_t i = 1; i < main_layers && starts.size() < max_planes; i++) {
+    if (!demoted.at(i))
+      starts.emplace_back(i);
+  }
+}
+
+void CostBasedAllocationStrategy::PrepareCandidates(
+    const std::vector<OverlayLayer> &layers, size_t main_layers) {
+  // Layers are offered planes in order of the memory traffic they save.
+  savings_.resize(main_layers);
+  candidates_.clear();
+  for (size_t i = 0; i < main_layers; i++) {
+    savings_.at(i) = GetLayerSavings(layers.at(i));
+    if (savings_.at(i) > 0)
+      candidates_.emplace_back(i);
+  }
+
+  const std::vector<int64_t> &savings = savings_;
+  std::stable_sort(candidates_.begin(), candidates_.end(),
+                   [&savings](size_t l, size_t r) {
+                     return savings.at(l) > savings.at(r);
+                   });
+}
+
+void CostBasedAllocationStrategy::SelectPlaneStarts(
+    const PlaneAllocationContext &context, const std::vector<bool> &demoted,
+    size_t main_layers, size_t layers_end, std::vector<size_t> &starts) {
+  size_t max_planes = context.GetOverlayPlanes().size() + 1;
+  std::vector<bool> is_start(main_layers, false);
+  is_start.at(0) = true;
+  size_t planes_in_use = 1;
+  for (size_t layer : candidates_) {
+    if (demoted.at(layer))
+      continue;
+
+    // A layer is only scanned out on its own when the layer above it
+    // starts a new plane, anything in between gets composited.
+    size_t next = layer + 1;
+    bool needs_next = next != layers_end;
+    if (needs_next && (next >= main_layers || demoted.at(next)))
+      continue;
+
+    size_t needed = is_start.at(layer) ? 0 : 1;
+    if (needs_next && !is_start.at(next))
+      needed++;
+
+    if (planes_in_use + needed > max_planes)
+      continue;
+
+    is_start.at(layer) = true;
+    if (needs_next)
+      is_start.at(next) = true;
+
+    planes_in_use += needed;
+  }
+
+  starts.clear();
+  for (size_t i = 0; i < main_layers; i++) {
+    if (is_start.at(i))
+      starts.emplace_back(i);
+  }
+}
+
+ExhaustiveAllocationStrategy::ExhaustiveAllocationStrategy(
+    uint32_t time_budget_us)
+    : time_budget_us_(time_budget_us) {
+}
+
+void ExhaustiveAllocationStrategy::EnumerateStarts(
+    size_t first, size_t main_layers, size_t max_planes,
+    std::vector<size_t> &starts) {
+  if (candidates_.size() >= kMaxExhaustiveConfigurations)
+    return;
+
+  candidates_.emplace_back();
+  candidates_.back().starts = starts;
+  if (starts.size() >= max_planes)
+    return;
+
+  for (size_t i = first; i < main_layers; i++) {
+    starts.emplace_back(i);
+    EnumerateStarts(i + 1, main_layers, max_planes, starts);
+    starts.pop_back();
+  }
+}
+
+bool ExhaustiveAllocationStrategy::Allocate(
+    PlaneAllocationContext &context, std::vector<OverlayLayer> &layers,
+    bool pending_modeset, DisplayPlaneStateList &composition) {
+  size_t total_layers = layers.size();
+  if (pending_modeset && total_layers > 1) {
+    context.ComposeAllLayersOnPrimary(layers, composition);
+    return true;
+  }
+
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::microseconds(time_budget_us_);
+  OverlayLayer *cursor_layer = GetCursorLayer(layers);
+  size_t main_layers = cursor_layer ? total_layers - 1 : total_layers;
+  size_t max_planes = context.GetOverlayPlanes().size() + 1;
+
+  // Every subset of layers (the bottom one always included) may start a
+  // plane.
+  candidates_.clear();
+  std::vector<size_t> starts(1, 0);
+  EnumerateStarts(1, main_layers, max_planes, starts);
+  if (candidates_.size() >= kMaxExhaustiveConfigurations) {
+    IDISPLAYMANAGERTRACE(
+        "Too many layers for exhaustive search, using cost based "
+        "allocation.");
+    return fallback_.Allocate(context, layers, pending_modeset, composition);
+  }
+
+  std::vector<int64_t> savings(main_layers);
+  for (size_t i = 0; i < main_layers; i++)
+    savings.at(i) = GetLayerSavings(layers.at(i));
+
+  DisplayPlane *cursor_plane = context.GetCursorPlane();
+  bool cursor_allowed = cursor_layer && cursor_plane &&
+                        context.CanScanout(cursor_plane, cursor_layer);
+  int64_t cursor_savings = cursor_allowed ? GetLayerSavings(*cursor_layer) : 0;
+  size_t configurations = candidates_.size();
+  for (size_t i = 0; i < configurations; i++) {
+    Candidate &candidate = candidates_.at(i);
+    candidate.cursor_on_plane = false;
+    candidate.savings = 0;
+    if (cursor_allowed) {
+      Candidate with_cursor = candidate;
+      with_cursor.cursor_on_plane = true;
+      candidates_.emplace_back(with_cursor);
+    }
+  }
+
+  // Only layers which get a plane of their own avoid GPU composition.
+  for (Candidate &candidate : candidates_) {
+    size_t layers_end = candidate.cursor_on_plane ? main_layers : total_layers;
+    size_t planes = candidate.starts.size();
+    for (size_t i = 0; i < planes; i++) {
+      size_t end = i + 1 < planes ? candidate.starts.at(i + 1) : layers_end;
+      if (end - candidate.starts.at(i) == 1)
+        candidate.savings += savings.at(candidate.starts.at(i));
+    }
+
+    if (candidate.cursor_on_plane)
+      candidate.savings += cursor_savings;
+  }
+
+  std::stable_sort(candidates_.begin(), candidates_.end(),
+                   [](const Candidate &l, const Candidate &r) {
+                     return l.savings > r.savings;
+                   });
+
+  // Remembers CanScanout results per plane and layer, 0 unknown, 1 pass
+  // and 2 fail.
+  std::vector<uint8_t> can_scanout(max_planes * main_layers, 0);
+  std::vector<OverlayPlane> commit_planes;
+  size_t tested = 0;
+  for (const Candidate &candidate : candidates_) {
+    if (tested && std::chrono::steady_clock::now() >= deadline) {
+      IDISPLAYMANAGERTRACE("Exhaustive allocation ran out of time after %zu "
+                           "configurations.",
+                           tested);
+      break;
+    }
+
+    size_t layers_end = candidate.cursor_on_plane ? main_layers : total_layers;
+    size_t planes = candidate.starts.size();
+    bool usable = true;
+    for (size_t i = 0; i < planes && usable; i++) {
+      size_t start = candidate.starts.at(i);
+      size_t end = i + 1 < planes ? candidate.starts.at(i + 1) : layers_end;
+      if (end - start != 1)
+        continue;
+
+      uint8_t &result = can_scanout.at(i * main_layers + start);
+      if (!result)
+        result = context.CanScanout(GetPlane(context, i), &layers.at(start))
+                     ? 1
+                     : 2;
+
+      usable = result == 1;
+    }
+
+    if (!usable)
+      continue;
+
+    tested++;
+    bool render_layers = context.BuildComposition(
+        layers, candidate.starts, layers_end,
+        candidate.cursor_on_plane ? cursor_layer : NULL, composition);
+
+    commit_planes.clear();
+    for (DisplayPlaneState &plane : composition) {
+      commit_planes.emplace_back(
+          OverlayPlane(plane.plane(), plane.GetOverlayLayer()));
+    }
+
+    if (context.TestCommitCached(commit_planes)) {
+      context.ResetInFlightTargets();
+      return render_layers;
+    }
+
+    context.ReleaseOffScreenTargets();
+    composition.clear();
+  }
+
+  context.ReleaseOffScreenTargets();
+  context.ComposeAllLayersOnPrimary(layers, composition);
+  return true;
+}
+
+}  // namespace hwcomposer
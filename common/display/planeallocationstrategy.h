@@ -0,0 +1,184 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef PLANE_ALLOCATION_STRATEGY_H_
+#define PLANE_ALLOCATION_STRATEGY_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include <hwcdefs.h>
+
+#include "displayplanestate.h"
+
+namespace hwcomposer {
+
+class PlaneAllocationContext;
+struct OverlayLayer;
+
+// Decides which layers are scanned out from which plane and which ones
+// are composited by GPU.
+class PlaneAllocationStrategy {
+ public:
+  struct Stats {
+    uint64_t frames = 0;
+    uint64_t test_commits = 0;
+    uint64_t decision_time_us = 0;
+    uint64_t last_test_commits = 0;
+    uint64_t last_decision_time_us = 0;
+  };
+
+  virtual ~PlaneAllocationStrategy() {
+  }
+
+  // Fills composition with the planes to be used for layers. Returns true
+  // if any of the planes needs to be composited by GPU.
+  virtual bool Allocate(PlaneAllocationContext &context,
+                        std::vector<OverlayLayer> &layers,
+                        bool pending_modeset,
+                        DisplayPlaneStateList &composition) = 0;
+
+  virtual HWCPlaneAllocation Type() const = 0;
+
+  virtual const char *Name() const = 0;
+
+  void UpdateStats(uint64_t test_commits, uint64_t decision_time_us);
+
+  const Stats &GetStats() const {
+    return stats_;
+  }
+
+ private:
+  Stats stats_;
+};
+
+std::unique_ptr<PlaneAllocationStrategy> CreatePlaneAllocationStrategy(
+    HWCPlaneAllocation allocation);
+
+// Probes planes one layer at a time in z-order.
+class GreedyAllocationStrategy : public PlaneAllocationStrategy {
+ public:
+  bool Allocate(PlaneAllocationContext &context,
+                std::vector<OverlayLayer> &layers, bool pending_modeset,
+                DisplayPlaneStateList &composition) override;
+
+  HWCPlaneAllocation Type() const override {
+    return HWCPlaneAllocation::kGreedy;
+  }
+
+  const char *Name() const override {
+    return "Greedy";
+  }
+};
+
+// Tests the most optimistic complete assignment first. When it fails,
+// bisects to the first offending plane and demotes its layer to GPU
+// composition, one layer at a time.
+class WholeConfigAllocationStrategy : public PlaneAllocationStrategy {
+ public:
+  bool Allocate(PlaneAllocationContext &context,
+                std::vector<OverlayLayer> &layers, bool pending_modeset,
+                DisplayPlaneStateList &composition) override;
+
+  HWCPlaneAllocation Type() const override {
+    return HWCPlaneAllocation::kWholeConfig;
+  }
+
+  const char *Name() const override {
+    return "WholeConfig";
+  }
+
+ protected:
+  // Called once per frame before any plane is selected.
+  virtual void PrepareCandidates(const std::vector<OverlayLayer> &layers,
+                                 size_t main_layers);
+
+  // Picks the layers which start a new plane. Layers in demoted failed to
+  // be scanned out before and must not start a plane.
+  virtual void SelectPlaneStarts(const PlaneAllocationContext &context,
+                                 const std::vector<bool> &demoted,
+                                 size_t main_layers, size_t layers_end,
+                                 std::vector<size_t> &starts);
+};
+
+// Same search as WholeConfigAllocationStrategy, but planes go to the
+// layers which save the most memory traffic (see PlaneCostModel).
+class CostBasedAllocationStrategy : public WholeConfigAllocationStrategy {
+ public:
+  HWCPlaneAllocation Type() const override {
+    return HWCPlaneAllocation::kCostBased;
+  }
+
+  const char *Name() const override {
+    return "CostBased";
+  }
+
+ protected:
+  void PrepareCandidates(const std::vector<OverlayLayer> &layers,
+                         size_t main_layers) override;
+
+  void SelectPlaneStarts(const PlaneAllocationContext &context,
+                         const std::vector<bool> &demoted, size_t main_layers,
+                         size_t layers_end,
+                         std::vector<size_t> &starts) override;
+
+ private:
+  std::vector<int64_t> savings_;
+  std::vector<size_t> candidates_;
+};
+
+// Tries every plane assignment in order of estimated savings until one
+// passes a test commit or the time budget runs out.
+class ExhaustiveAllocationStrategy : public PlaneAllocationStrategy {
+ public:
+  // Time we are willing to spend searching per frame.
+  static const uint32_t kDefaultTimeBudgetUs = 2000;
+
+  explicit ExhaustiveAllocationStrategy(
+      uint32_t time_budget_us = kDefaultTimeBudgetUs);
+
+  bool Allocate(PlaneAllocationContext &context,
+                std::vector<OverlayLayer> &layers, bool pending_modeset,
+                DisplayPlaneStateList &composition) override;
+
+  HWCPlaneAllocation Type() const override {
+    return HWCPlaneAllocation::kExhaustive;
+  }
+
+  const char *Name() const override {
+    return "Exhaustive";
+  }
+
+ private:
+  struct Candidate {
+    std::vector<size_t> starts;
+    bool cursor_on_plane;
+    int64_t savings;
+  };
+
+  void EnumerateStarts(size_t first, size_t main_layers, size_t max_planes,
+                       std::vector<size_t> &starts);
+
+  uint32_t time_budget_us_;
+  std::vector<Candidate> candidates_;
+  // Used when there are too many layers to search them all.
+  CostBasedAllocationStrategy fallback_;
+};
+
+}  // namespace hwcomposer
+#endif  // PLANE_ALLOCATION_STRATEGY_H_
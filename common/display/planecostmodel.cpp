@@ -0,0 +1,99 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "planecostmodel.h"
+
+#include <drm_fourcc.h>
+
+namespace hwcomposer {
+
+// Render targets are always allocated as 32 bit ARGB.
+static const uint64_t kRenderTargetBytesPerPixel = 4;
+
+static uint64_t GetArea(const HwcRect<int> &rect) {
+  if (rect.right <= rect.left || rect.bottom <= rect.top)
+    return 0;
+
+  return static_cast<uint64_t>(rect.right - rect.left) *
+         static_cast<uint64_t>(rect.bottom - rect.top);
+}
+
+static uint64_t GetArea(const HwcRect<float> &rect) {
+  return GetArea(HwcRect<int>(rect));
+}
+
+uint32_t PlaneCostModel::GetBitsPerPixel(uint32_t format) {
+  switch (format) {
+    case DRM_FORMAT_C8:
+    case DRM_FORMAT_R8:
+      return 8;
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_NV21:
+    case DRM_FORMAT_YUV420:
+    case DRM_FORMAT_YVU420:
+      return 12;
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_BGR565:
+    case DRM_FORMAT_XRGB1555:
+    case DRM_FORMAT_ARGB1555:
+    case DRM_FORMAT_XRGB4444:
+    case DRM_FORMAT_ARGB4444:
+    case DRM_FORMAT_YUYV:
+    case DRM_FORMAT_YVYU:
+    case DRM_FORMAT_UYVY:
+    case DRM_FORMAT_VYUY:
+    case DRM_FORMAT_NV16:
+    case DRM_FORMAT_NV61:
+      return 16;
+    case DRM_FORMAT_RGB888:
+    case DRM_FORMAT_BGR888:
+      return 24;
+    default:
+      break;
+  }
+
+  return 32;
+}
+
+uint64_t PlaneCostModel::GetCompositionCost(const PlaneCostInput &layer) {
+  uint64_t dst_area = GetArea(layer.display_frame);
+  uint64_t src_area = GetArea(layer.source_crop);
+  uint64_t bpp = GetBitsPerPixel(layer.format);
+  // Upscaling samples every output pixel, downscaling still has to touch
+  // every source texel.
+  uint64_t sampled = src_area > dst_area ? src_area : dst_area;
+  uint64_t cost = (sampled * bpp) / 8;
+  cost += dst_area * kRenderTargetBytesPerPixel;
+
+  // Blended layers, and opaque ones faded with a plane alpha, also need
+  // to read back the destination.
+  if (layer.blending != HWCBlending::kBlendingNone || layer.alpha != 0xff)
+    cost += dst_area * kRenderTargetBytesPerPixel;
+
+  return cost;
+}
+
+uint64_t PlaneCostModel::GetScanoutCost(const PlaneCostInput &layer) {
+  uint64_t bpp = GetBitsPerPixel(layer.format);
+  return ((GetArea(layer.source_crop) * bpp) / 8) + kPlaneOverheadBytes;
+}
+
+int64_t PlaneCostModel::GetOverlaySavings(const PlaneCostInput &layer) {
+  return static_cast<int64_t>(GetCompositionCost(layer)) -
+         static_cast<int64_t>(GetScanoutCost(layer));
+}
+
+}  // namespace hwcomposer
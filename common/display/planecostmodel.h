@@ -0,0 +1,61 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef PLANE_COST_MODEL_H_
+#define PLANE_COST_MODEL_H_
+
+#include <stdint.h>
+
+#include <hwcdefs.h>
+
+namespace hwcomposer {
+
+// Everything the cost model needs to know about a layer. Kept free of any
+// DRM or buffer state so the model can be evaluated without hardware.
+struct PlaneCostInput {
+  HwcRect<int> display_frame;
+  HwcRect<float> source_crop;
+  uint32_t format = 0;
+  uint8_t alpha = 0xff;
+  HWCBlending blending = HWCBlending::kBlendingNone;
+};
+
+// Estimates memory traffic, in bytes per frame, of the two ways a layer can
+// reach the screen.
+class PlaneCostModel {
+ public:
+  // Fixed cost we charge for enabling a plane, roughly the traffic of a
+  // 128x128 ARGB layer. Keeps tiny layers from taking up overlays.
+  static const uint64_t kPlaneOverheadBytes = 64 * 1024;
+
+  static uint32_t GetBitsPerPixel(uint32_t format);
+
+  // Traffic needed to composite the layer into an ARGB render target with
+  // the GPU: sampling the source, blending with the destination and
+  // writing the result.
+  static uint64_t GetCompositionCost(const PlaneCostInput &layer);
+
+  // Traffic needed by the display engine to fetch the layer when it is
+  // scanned out from its own plane.
+  static uint64_t GetScanoutCost(const PlaneCostInput &layer);
+
+  // Bytes saved per frame by giving the layer its own plane instead of
+  // compositing it. Negative when using a plane is not worth it.
+  static int64_t GetOverlaySavings(const PlaneCostInput &layer);
+};
+
+}  // namespace hwcomposer
+#endif  // PLANE_COST_MODEL_H_
@@ -0,0 +1,111 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "bufferimportcache.h"
+
+#include <sys/stat.h>
+
+#include "bufferimportlog.h"
+
+namespace hwcomposer {
+
+// static
+uint64_t BufferImportCache::GetBufferIdentity(int fd) {
+  struct stat buf;
+  if (fd < 0 || fstat(fd, &buf))
+    return 0;
+
+  return buf.st_ino;
+}
+
+bool BufferImportCache::Lookup(const void *handle, uint64_t identity,
+                               HwcBuffer *bo) {
+  ScopedSpinLock lock(lock_);
+  auto it = handles_.find(handle);
+  if (it != handles_.end()) {
+    Import &import = imports_.at(it->second.import_id);
+    if (!identity || import.identity == identity) {
+      it->second.last_used = ++last_used_;
+      *bo = import.bo;
+      return true;
+    }
+
+    // The buffer this handle was imported for is gone.
+    EvictLocked(it);
+  }
+
+  if (!identity)
+    return false;
+
+  auto shared = identities_.find(identity);
+  if (shared == identities_.end())
+    return false;
+
+  Import &import = imports_.at(shared->second);
+  import.handles++;
+  handles_[handle] = Handle{shared->second, ++last_used_};
+  *bo = import.bo;
+  return true;
+}
+
+void BufferImportCache::Insert(const void *handle, uint64_t identity,
+                               HwcBuffer *bo) {
+  ScopedSpinLock lock(lock_);
+  auto it = handles_.find(handle);
+  if (it != handles_.end())
+    EvictLocked(it);
+
+  bo->import_id = BufferImportLog::GetInstance().NewImportId();
+  imports_[bo->import_id] = Import{*bo, identity, 1};
+  handles_[handle] = Handle{bo->import_id, ++last_used_};
+  if (identity)
+    identities_[identity] = bo->import_id;
+
+  while (handles_.size() > kMaxHandles) {
+    auto oldest = handles_.begin();
+    for (auto i = handles_.begin(); i != handles_.end(); ++i) {
+      if (i->second.last_used < oldest->second.last_used)
+        oldest = i;
+    }
+
+    EvictLocked(oldest);
+  }
+}
+
+void BufferImportCache::Evict(const void *handle) {
+  ScopedSpinLock lock(lock_);
+  auto it = handles_.find(handle);
+  if (it != handles_.end())
+    EvictLocked(it);
+}
+
+void BufferImportCache::EvictLocked(
+    std::unordered_map<const void *, Handle>::iterator it) {
+  uint64_t import_id = it->second.import_id;
+  handles_.erase(it);
+  auto import = imports_.find(import_id);
+  if (--import->second.handles)
+    return;
+
+  auto identity = identities_.find(import->second.identity);
+  if (identity != identities_.end() && identity->second == import_id)
+    identities_.erase(identity);
+
+  imports_.erase(import);
+  BufferImportLog::GetInstance().Released(import_id);
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,81 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef BUFFER_IMPORT_CACHE_H_
+#define BUFFER_IMPORT_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unordered_map>
+
+#include <hwcbuffer.h>
+#include <spinlock.h>
+
+namespace hwcomposer {
+
+// Imports made by a NativeBufferHandler, so a buffer is imported once no
+// matter how many frames show it and without help from the allocator.
+// Entries are keyed on the native handle. Handles may be freed and handed
+// out again for another buffer, so a handle with a known identity (see
+// GetBufferIdentity) only matches while the same buffer is behind it.
+// Handles of the same buffer share one reference counted import, which is
+// reported to BufferImportLog as released once the last of them is
+// evicted: when the handler destroys the buffer, when the handle shows up
+// with another buffer behind it, or when it is the least recently used of
+// more than kMaxHandles handles.
+class BufferImportCache {
+ public:
+  static const size_t kMaxHandles = 64;
+
+  // Inode of the dma-buf |fd| refers to, which stays unique as long as the
+  // buffer lives. 0 if it can't be told.
+  static uint64_t GetBufferIdentity(int fd);
+
+  // Fills |bo| with the import cached for |handle|, or for another handle of
+  // the buffer |identity|. Returns false if the buffer has to be imported.
+  bool Lookup(const void *handle, uint64_t identity, HwcBuffer *bo);
+
+  // Caches the import |bo| of |handle| and assigns its import id.
+  void Insert(const void *handle, uint64_t identity, HwcBuffer *bo);
+
+  // Drops |handle|, called once the buffer behind it is destroyed.
+  void Evict(const void *handle);
+
+ private:
+  struct Import {
+    HwcBuffer bo;
+    uint64_t identity;
+    uint32_t handles;
+  };
+
+  struct Handle {
+    uint64_t import_id;
+    uint64_t last_used;
+  };
+
+  void EvictLocked(std::unordered_map<const void *, Handle>::iterator it);
+
+  std::unordered_map<const void *, Handle> handles_;
+  std::unordered_map<uint64_t, Import> imports_;
+  // Import ids of the buffers with a known identity.
+  std::unordered_map<uint64_t, uint64_t> identities_;
+  uint64_t last_used_ = 0;
+  SpinLock lock_;
+};
+
+}  // namespace hwcomposer
+#endif  // BUFFER_IMPORT_CACHE_H_
@@ -0,0 +1,91 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef BUFFER_IMPORT_LOG_H_
+#define BUFFER_IMPORT_LOG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <spinlock.h>
+
+namespace hwcomposer {
+
+// Hands out the import ids NativeBufferHandler implementations put into
+// HwcBuffer, and logs the imports whose buffer was destroyed. GEM handles
+// are handed out again once a buffer is freed, so anything kept per buffer
+// across frames is keyed on the import id instead and dropped once the
+// import shows up in the log. Buffers are destroyed on any thread.
+class BufferImportLog {
+ public:
+  static BufferImportLog &GetInstance() {
+    static BufferImportLog log;
+    return log;
+  }
+
+  // Never returns 0.
+  uint64_t NewImportId() {
+    return ++last_id_;
+  }
+
+  // Called by the buffer handler once the buffer imported as |import_id|
+  // is gone.
+  void Released(uint64_t import_id) {
+    ScopedSpinLock lock(lock_);
+    released_.push_back(import_id);
+    if (released_.size() > kMaxEntries) {
+      released_.pop_front();
+      first_position_++;
+    }
+  }
+
+  // Position of the next entry, for readers which only care about buffers
+  // released from now on.
+  uint64_t GetPosition() {
+    ScopedSpinLock lock(lock_);
+    return first_position_ + released_.size();
+  }
+
+  // Appends the ids released since |*position| to |ids| and advances
+  // |*position|. Returns false if some of them were already dropped from
+  // the log, the caller then has to assume any buffer may be gone.
+  bool GetReleased(uint64_t *position, std::vector<uint64_t> *ids) {
+    ScopedSpinLock lock(lock_);
+    bool complete = *position >= first_position_;
+    size_t i = complete ? *position - first_position_ : 0;
+    ids->insert(ids->end(), released_.begin() + i, released_.end());
+    *position = first_position_ + released_.size();
+    return complete;
+  }
+
+ private:
+  static const size_t kMaxEntries = 1024;
+
+  BufferImportLog() = default;
+
+  std::atomic<uint64_t> last_id_{0};
+  SpinLock lock_;
+  std::deque<uint64_t> released_;
+  // Position of released_.front().
+  uint64_t first_position_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // BUFFER_IMPORT_LOG_H_
@@ -0,0 +1,94 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef FRAME_VECTOR_H_
+#define FRAME_VECTOR_H_
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace hwcomposer {
+
+// Vector for per frame scratch data. clear() keeps the elements alive, so
+// whatever storage they own, i.e. nested vectors, is reused by the next
+// frame instead of being freed and allocated again. Elements handed out by
+// emplace_back() still hold the contents of an earlier frame and have to
+// be reset by the caller.
+template <typename T>
+class FrameVector {
+ public:
+  typedef typename std::vector<T>::iterator iterator;
+  typedef typename std::vector<T>::const_iterator const_iterator;
+
+  T &emplace_back() {
+    if (size_ == elements_.size())
+      elements_.emplace_back();
+
+    return elements_[size_++];
+  }
+
+  void pop_back() {
+    size_--;
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  T &operator[](size_t index) {
+    return elements_[index];
+  }
+
+  const T &operator[](size_t index) const {
+    return elements_[index];
+  }
+
+  T &back() {
+    return elements_[size_ - 1];
+  }
+
+  iterator begin() {
+    return elements_.begin();
+  }
+
+  iterator end() {
+    return elements_.begin() + size_;
+  }
+
+  const_iterator begin() const {
+    return elements_.begin();
+  }
+
+  const_iterator end() const {
+    return elements_.begin() + size_;
+  }
+
+ private:
+  std::vector<T> elements_;
+  size_t size_ = 0;
+};
+
+}  // namespace hwcomposer
+#endif  // FRAME_VECTOR_H_
@@ -163,11 +163,11 @@ class TraceFunc {
       "Dumping DisplayPlaneState of Current Composition planes "           \
       "-----------------------------");                                    \
   DUMPTRACE("Frame: %d", frame_);                                          \
-  DUMPTRACE("Total Layers for this Frame: %d", layers.size());             \
+  DUMPTRACE("Total Layers for this Frame: %d", layers_.size());            \
   DUMPTRACE("Total Planes in use for this Frame: %d",                      \
-            current_composition_planes.size());                            \
+            composition_planes_.size());                                   \
   int plane_index = 1;                                                     \
-  for (DisplayPlaneState & comp_plane : current_composition_planes) {      \
+  for (DisplayPlaneState & comp_plane : composition_planes_) {             \
     DUMPTRACE("Composition Plane State for Index: %d", plane_index);       \
     const std::vector<size_t> &source_layers = comp_plane.source_layers(); \
     switch (comp_plane.GetCompositionState()) {                            \
@@ -177,7 +177,7 @@ class TraceFunc {
         DUMPTRACE("Layers Index:");                                        \
         for (size_t primary_index : source_layers) {                       \
           DUMPTRACE("index: %d", primary_index);                           \
-          layers.at(primary_index).Dump();                                 \
+          layers_.at(primary_index).Dump();                                \
         }                                                                  \
         break;                                                             \
       case DisplayPlaneState::State::kScanout:                             \
@@ -190,7 +190,7 @@ class TraceFunc {
         DUMPTRACE("Layers Index:");                                        \
         for (size_t overlay_index : source_layers) {                       \
           DUMPTRACE("index: %d", overlay_index);                           \
-          layers.at(overlay_index).Dump();                                 \
+          layers_.at(overlay_index).Dump();                                \
         }                                                                  \
         break;                                                             \
       default:                                                             \
@@ -0,0 +1,80 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef LRU_CACHE_H_
+#define LRU_CACHE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace hwcomposer {
+
+// Fixed size map which evicts the least recently used entry once full.
+template <typename Key, typename Value>
+class LRUCache {
+ public:
+  explicit LRUCache(size_t capacity) : capacity_(capacity) {
+  }
+
+  // Returns the cached value for key or NULL. A successful lookup marks the
+  // entry as most recently used.
+  Value *Find(const Key &key) {
+    auto it = lookup_.find(key);
+    if (it == lookup_.end())
+      return NULL;
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->second;
+  }
+
+  void Insert(const Key &key, const Value &value) {
+    auto it = lookup_.find(key);
+    if (it != lookup_.end()) {
+      it->second->second = value;
+      entries_.splice(entries_.begin(), entries_, it->second);
+      return;
+    }
+
+    if (entries_.size() >= capacity_) {
+      lookup_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+
+    entries_.emplace_front(key, value);
+    lookup_[key] = entries_.begin();
+  }
+
+  void Clear() {
+    entries_.clear();
+    lookup_.clear();
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+ private:
+  typedef std::list<std::pair<Key, Value>> EntryList;
+  EntryList entries_;
+  std::unordered_map<Key, typename EntryList::iterator> lookup_;
+  size_t capacity_;
+};
+
+}  // namespace hwcomposer
+#endif  // LRU_CACHE_H_
@@ -415,6 +415,7 @@ HWC2::Error DrmHwcTwo::HwcDisplay::PresentDisplay(int32_t *retire_fence) {
   std::vector<hwcomposer::HwcLayer *> layers;
   // now that they're ordered by z, add them to the composition
   for (std::pair<const uint32_t, DrmHwcTwo::HwcLayer *> &l : z_map) {
+    l.second->UpdateSurfaceDamage();
     layers.emplace_back(l.second->GetLayer());
   }
   if (layers.empty())
@@ -476,6 +477,20 @@ HWC2::Error DrmHwcTwo::HwcDisplay::SetColorTransform(const float *matrix,
   return unsupported(__func__, matrix, hint);
 }
 
+HWC2::Error DrmHwcTwo::HwcDisplay::SetCursorPosition(hwc2_layer_t layer,
+                                                     int32_t x, int32_t y) {
+  supported(__func__);
+  HwcLayer &cursor = get_layer(layer);
+  cursor.SetCursorPosition(x, y);
+  if (cursor.validated_type() != HWC2::Composition::Cursor)
+    return HWC2::Error::None;
+
+  // Commits only the cursor plane position when possible, otherwise the
+  // new position is used by the next PresentDisplay.
+  display_->SetCursorPosition(x, y);
+  return HWC2::Error::None;
+}
+
 HWC2::Error DrmHwcTwo::HwcDisplay::SetOutputBuffer(buffer_handle_t buffer,
                                                    int32_t release_fence) {
   supported(__func__);
@@ -552,6 +567,9 @@ HWC2::Error DrmHwcTwo::HwcLayer::SetCursorPosition(int32_t x, int32_t y) {
   supported(__func__);
   cursor_x_ = x;
   cursor_y_ = y;
+  const hwcomposer::HwcRect<int> &frame = hwc_layer_.GetDisplayFrame();
+  hwc_layer_.SetDisplayFrame(hwcomposer::HwcRect<int>(
+      x, y, x + frame.right - frame.left, y + frame.bottom - frame.top));
   return HWC2::Error::None;
 }
 
@@ -639,11 +657,38 @@ HWC2::Error DrmHwcTwo::HwcLayer::SetLayerSourceCrop(hwc_frect_t crop) {
 
 HWC2::Error DrmHwcTwo::HwcLayer::SetLayerSurfaceDamage(hwc_region_t damage) {
   supported(__func__);
-  // TODO: We don't use surface damage, marking as unsupported
-  unsupported(__func__, damage);
+  // An empty region means the whole buffer is damaged. Otherwise only the
+  // bounding rectangle of the region is tracked.
+  has_surface_damage_ = damage.numRects > 0;
+  surface_damage_ = hwcomposer::HwcRect<int>(0, 0, 0, 0);
+  for (size_t i = 0; i < damage.numRects; i++) {
+    const hwc_rect_t &rect = damage.rects[i];
+    if (rect.right <= rect.left || rect.bottom <= rect.top)
+      continue;
+
+    if (surface_damage_.right <= surface_damage_.left) {
+      surface_damage_ = hwcomposer::HwcRect<int>(rect.left, rect.top,
+                                                 rect.right, rect.bottom);
+      continue;
+    }
+
+    surface_damage_.left = std::min(surface_damage_.left, rect.left);
+    surface_damage_.top = std::min(surface_damage_.top, rect.top);
+    surface_damage_.right = std::max(surface_damage_.right, rect.right);
+    surface_damage_.bottom = std::max(surface_damage_.bottom, rect.bottom);
+  }
+
   return HWC2::Error::None;
 }
 
+void DrmHwcTwo::HwcLayer::UpdateSurfaceDamage() {
+  if (has_surface_damage_) {
+    hwc_layer_.SetSurfaceDamage(surface_damage_);
+  } else {
+    hwc_layer_.ResetSurfaceDamage();
+  }
+}
+
 HWC2::Error DrmHwcTwo::HwcLayer::SetLayerTransform(int32_t transform) {
   supported(__func__);
   // 270* and 180* cannot be combined with flips. More specifically, they
@@ -829,8 +874,9 @@ hwc2_function_pointer_t DrmHwcTwo::HookDevGetFunction(
     // Layer functions
     case HWC2::FunctionDescriptor::SetCursorPosition:
       return ToHook<HWC2_PFN_SET_CURSOR_POSITION>(
-          LayerHook<decltype(&HwcLayer::SetCursorPosition),
-                    &HwcLayer::SetCursorPosition, int32_t, int32_t>);
+          DisplayHook<decltype(&HwcDisplay::SetCursorPosition),
+                      &HwcDisplay::SetCursorPosition, hwc2_layer_t, int32_t,
+                      int32_t>);
     case HWC2::FunctionDescriptor::SetLayerBlendMode:
       return ToHook<HWC2_PFN_SET_LAYER_BLEND_MODE>(
           LayerHook<decltype(&HwcLayer::SetLayerBlendMode),
@@ -80,6 +80,11 @@ class DrmHwcTwo : public hwc2_device_t {
       return &hwc_layer_;
     }
 
+    // Passes the surface damage SurfaceFlinger reported for the buffer
+    // about to be presented on to hwc_layer_. An unchanged buffer comes
+    // with a single empty rect, which leaves nothing damaged.
+    void UpdateSurfaceDamage();
+
     // Layer hooks
     HWC2::Error SetCursorPosition(int32_t x, int32_t y);
     HWC2::Error SetLayerBlendMode(int32_t mode);
@@ -107,6 +112,9 @@ class DrmHwcTwo : public hwc2_device_t {
     android_dataspace_t dataspace_ = HAL_DATASPACE_UNKNOWN;
     hwcomposer::HwcLayer hwc_layer_;
     struct gralloc_handle native_handle_;
+    hwcomposer::HwcRect<int> surface_damage_ =
+        hwcomposer::HwcRect<int>(0, 0, 0, 0);
+    bool has_surface_damage_ = false;
   };
 
   struct HwcCallback {
@@ -161,6 +169,7 @@ class DrmHwcTwo : public hwc2_device_t {
                                 int32_t dataspace, hwc_region_t damage);
     HWC2::Error SetColorMode(int32_t mode);
     HWC2::Error SetColorTransform(const float *matrix, int32_t hint);
+    HWC2::Error SetCursorPosition(hwc2_layer_t layer, int32_t x, int32_t y);
     HWC2::Error SetOutputBuffer(buffer_handle_t buffer, int32_t release_fence);
     HWC2::Error SetPowerMode(int32_t mode);
     HWC2::Error SetVsyncEnabled(int32_t enabled);
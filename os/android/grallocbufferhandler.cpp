@@ -29,6 +29,8 @@
 #include <gralloc_drm_handle.h>
 #endif
 
+#include <unistd.h>
+
 #include <hwcdefs.h>
 #include <hwctrace.h>
 #include "drmhwcgralloc.h"
@@ -84,6 +86,7 @@ bool GrallocBufferHandler::DestroyBuffer(HWCNativeHandle handle) {
     return false;
 
   if (handle->handle_) {
+    import_cache_.Evict(handle->handle_);
     gralloc_->unregisterBuffer(gralloc_, handle->handle_);
     handle->buffer_.clear();
   }
@@ -94,7 +97,8 @@ bool GrallocBufferHandler::DestroyBuffer(HWCNativeHandle handle) {
   return true;
 }
 #ifdef USE_MINIGBM
-bool GrallocBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
+bool GrallocBufferHandler::ImportGrallocBuffer(HWCNativeHandle handle,
+                                               HwcBuffer *bo) {
   memset(bo, 0, sizeof(struct HwcBuffer));
   int ret = gralloc_->perform(gralloc_, GRALLOC_MODULE_PERFORM_DRM_IMPORT,
                               handle->handle_, fd_, bo);
@@ -118,7 +122,8 @@ bool GrallocBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
   return true;
 }
 #else
-bool GrallocBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
+bool GrallocBufferHandler::ImportGrallocBuffer(HWCNativeHandle handle,
+                                               HwcBuffer *bo) {
   hwc_drm_bo_t hwc_bo;
   int ret = gralloc_->perform(gralloc_, GRALLOC_MODULE_PERFORM_DRM_IMPORT, fd_,
                               handle->handle_, &hwc_bo);
@@ -153,4 +158,32 @@ bool GrallocBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
   return true;
 }
 #endif
+
+bool GrallocBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
+  // Client buffers are freed without us being told. The handle of a freed
+  // buffer may come back for a new one, its first fd tells them apart.
+  const native_handle_t *native_handle = handle->handle_;
+  uint64_t identity =
+      native_handle->numFds > 0
+          ? BufferImportCache::GetBufferIdentity(native_handle->data[0])
+          : 0;
+  if (import_cache_.Lookup(native_handle, identity, bo))
+    return true;
+
+  if (!ImportGrallocBuffer(handle, bo))
+    return false;
+
+#ifdef USE_MINIGBM
+  // DRM_IMPORT opened a new fd for us. Use the one of the handle instead,
+  // which is valid whenever the buffer is shown, so cached imports don't
+  // keep freed buffers alive.
+  if (native_handle->numFds > 0) {
+    close(bo->prime_fd);
+    bo->prime_fd = native_handle->data[0];
+  }
+#endif
+
+  import_cache_.Insert(native_handle, identity, bo);
+  return true;
+}
 }
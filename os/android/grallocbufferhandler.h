@@ -21,6 +21,8 @@
 
 #include <hardware/gralloc.h>
 
+#include "bufferimportcache.h"
+
 namespace hwcomposer {
 
 class GpuDevice;
@@ -38,9 +40,11 @@ class GrallocBufferHandler : public NativeBufferHandler {
   bool ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) override;
 
  private:
+  bool ImportGrallocBuffer(HWCNativeHandle handle, HwcBuffer *bo);
   uint32_t ConvertHalFormatToDrm(uint32_t hal_format);
   uint32_t fd_;
   const gralloc_module_t *gralloc_;
+  BufferImportCache import_cache_;
 };
 
 }  // namespace hardware
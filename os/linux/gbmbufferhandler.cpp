@@ -21,6 +21,7 @@
 #include <xf86drm.h>
 #include <drm_fourcc.h>
 
+#include <bufferimportcache.h>
 #include <hwcbuffer.h>
 #include <hwcdefs.h>
 #include <hwctrace.h>
@@ -82,6 +83,7 @@ bool GbmBufferHandler::CreateBuffer(uint32_t w, uint32_t h, int format,
 }
 
 bool GbmBufferHandler::DestroyBuffer(HWCNativeHandle handle) {
+  import_cache_.Evict(handle);
   if (handle->bo) {
     gbm_bo_destroy(handle->bo);
     close(handle->import_data.fds[0]);
@@ -93,6 +95,11 @@ bool GbmBufferHandler::DestroyBuffer(HWCNativeHandle handle) {
 }
 
 bool GbmBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
+  uint64_t identity =
+      BufferImportCache::GetBufferIdentity(handle->import_data.fds[0]);
+  if (import_cache_.Lookup(handle, identity, bo))
+    return true;
+
   memset(bo, 0, sizeof(struct HwcBuffer));
   uint32_t aligned_width = handle->import_data.width;
   uint32_t aligned_height = handle->import_data.height;
@@ -114,7 +121,8 @@ bool GbmBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
   uint32_t gem_handles[4];
   bo->width = handle->import_data.width;
   bo->height = handle->import_data.height;
-  bo->prime_fd = dup(handle->import_data.fds[0]);
+  // The fd stays owned by the handle, no need to dup it.
+  bo->prime_fd = handle->import_data.fds[0];
   size_t total_planes = gbm_bo_get_num_planes(handle->bo);
   for (size_t i = 0; i < total_planes; i++) {
     bo->gem_handles[i] = gem_handle;
@@ -122,6 +130,7 @@ bool GbmBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
     bo->pitches[i] = gbm_bo_get_plane_stride(handle->bo, i);
   }
 
+  import_cache_.Insert(handle, identity, bo);
   return true;
 }
 }
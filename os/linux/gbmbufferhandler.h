@@ -21,6 +21,8 @@
 
 #include <nativebufferhandler.h>
 
+#include "bufferimportcache.h"
+
 namespace hwcomposer {
 
 class GpuDevice;
@@ -40,6 +42,7 @@ class GbmBufferHandler : public NativeBufferHandler {
  private:
   uint32_t fd_;
   struct gbm_device *device_;
+  BufferImportCache import_cache_;
 };
 
 }  // namespace hardware
@@ -74,75 +74,148 @@ struct Rect {
          << height();
   }
 };
-struct RectIDs {
+
+// Set of rect indices, |kWords| 64 bit words wide. RectIDs covers almost
+// every frame, WideRectIDs is for planes with more than 64 layers.
+template <size_t kWords>
+struct RectIDsT {
  public:
   typedef uint64_t TId;
 
-  RectIDs() : bitset(0) {
+  RectIDsT() {
+    for (size_t i = 0; i < kWords; i++)
+      bitset[i] = 0;
   }
 
-  RectIDs(TId id) : bitset(0) {
+  RectIDsT(TId id) : RectIDsT() {
     add(id);
   }
 
   void add(TId id) {
-    bitset |= ((uint64_t)1) << id;
+    bitset[id / 64] |= ((uint64_t)1) << (id % 64);
   }
 
   void subtract(TId id) {
-    bitset &= ~(((uint64_t)1) << id);
+    bitset[id / 64] &= ~(((uint64_t)1) << (id % 64));
+  }
+
+  // Adds |id| if it is missing, removes it otherwise.
+  void toggle(TId id) {
+    bitset[id / 64] ^= ((uint64_t)1) << (id % 64);
+  }
+
+  bool contains(TId id) const {
+    return (bitset[id / 64] >> (id % 64)) & 1;
   }
 
   bool isEmpty() const {
-    return bitset == 0;
+    uint64_t bits = 0;
+    for (size_t i = 0; i < kWords; i++)
+      bits |= bitset[i];
+    return bits == 0;
   }
 
+  // Ids 0 to 63.
   uint64_t getBits() const {
-    return bitset;
+    return bitset[0];
   }
 
-  bool operator==(const RectIDs &rhs) const {
-    return bitset == rhs.bitset;
+  // Ids |word| * 64 to |word| * 64 + 63.
+  uint64_t getWord(size_t word) const {
+    return bitset[word];
+  }
+
+  bool operator==(const RectIDsT &rhs) const {
+    for (size_t i = 0; i < kWords; i++) {
+      if (bitset[i] != rhs.bitset[i])
+        return false;
+    }
+    return true;
   }
 
-  bool operator<(const RectIDs &rhs) const {
-    return bitset < rhs.bitset;
+  bool operator<(const RectIDsT &rhs) const {
+    for (size_t i = kWords; i-- > 0;) {
+      if (bitset[i] != rhs.bitset[i])
+        return bitset[i] < rhs.bitset[i];
+    }
+    return false;
   }
 
-  RectIDs operator|(const RectIDs &rhs) const {
-    RectIDs ret;
-    ret.bitset = bitset | rhs.bitset;
+  RectIDsT operator|(const RectIDsT &rhs) const {
+    RectIDsT ret;
+    for (size_t i = 0; i < kWords; i++)
+      ret.bitset[i] = bitset[i] | rhs.bitset[i];
     return ret;
   }
 
-  RectIDs operator|(TId id) const {
-    RectIDs ret;
-    ret.bitset = bitset;
+  RectIDsT operator|(TId id) const {
+    RectIDsT ret = *this;
     ret.add(id);
     return ret;
   }
 
-  static const int max_elements = sizeof(TId) * 8;
+  static const size_t words = kWords;
+  static const int max_elements = sizeof(TId) * 8 * kWords;
 
  private:
-  uint64_t bitset;
+  uint64_t bitset[kWords];
 };
 
-template <typename TNum>
+typedef RectIDsT<1> RectIDs;
+typedef RectIDsT<8> WideRectIDs;
+
+template <typename TNum, typename TIds = RectIDs>
 struct RectSet {
-  RectIDs id_set;
+  TIds id_set;
   Rect<TNum> rect;
 
-  RectSet(const RectIDs &i, const Rect<TNum> &r) : id_set(i), rect(r) {
+  RectSet(const TIds &i, const Rect<TNum> &r) : id_set(i), rect(r) {
   }
 
-  bool operator==(const RectSet<TNum> &rhs) const {
+  bool operator==(const RectSet &rhs) const {
     return (id_set == rhs.id_set) && (rect == rhs.rect);
   }
 };
 
+// A left/right or top/bottom edge of rect |id|.
+struct DrawRegionsEdge {
+  int pos;
+  uint32_t id;
+  bool start;
+};
+
+// Buffers get_draw_regions() works in. Callers which run it every frame
+// keep one around, so the buffers are only grown, never reallocated.
+template <typename TIds>
+struct DrawRegionsScratchT {
+  typedef DrawRegionsEdge Edge;
+
+  std::vector<Edge> x_edges;
+  // Top and bottom edges of the rects the sweep line crosses, sorted.
+  std::vector<Edge> y_edges;
+  std::vector<RectSet<int, TIds>> open;
+  std::vector<RectSet<int, TIds>> next;
+};
+
+typedef DrawRegionsScratchT<RectIDs> DrawRegionsScratch;
+typedef DrawRegionsScratchT<WideRectIDs> WideDrawRegionsScratch;
+
+// Splits the area covered by |in| into disjoint rects, each tagged with
+// the indices of the rects of |in| covering it, and appends them to |out|.
+// Does nothing if |in| has more than TIds::max_elements rects. Defined for
+// RectIDs and WideRectIDs.
 void get_draw_regions(const std::vector<Rect<int>> &in,
                         std::vector<RectSet<int>> *out);
+template <typename TIds>
+void get_draw_regions(const std::vector<Rect<int>> &in,
+                      DrawRegionsScratchT<TIds> *scratch,
+                      std::vector<RectSet<int, TIds>> *out);
+
+// Joins regions with the same rects which together form a rect. Regions
+// straight from get_draw_regions() don't need it, it is for regions whose
+// id sets were edited afterwards. Defined for RectIDs and WideRectIDs.
+template <typename TIds>
+void merge_draw_regions(std::vector<RectSet<int, TIds>> *regions);
 }
 
 #endif
@@ -28,6 +28,11 @@ struct HwcBuffer {
   uint32_t gem_handles[4];
   uint32_t prime_fd;
   uint32_t usage;
+  // Identifies the import, see NativeBufferHandler::ImportBuffer.
+  uint64_t import_id;
+  // Set if the import isn't cached and prime_fd has to be closed by the
+  // caller once it is done with the buffer.
+  bool owns_prime_fd;
 };
 
 #endif  // HWC_BUFFER_H_
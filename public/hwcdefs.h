@@ -63,5 +63,13 @@ enum class DisplayType : int32_t {
   kHeadless = 3
 };
 
+// Algorithms available to assign layers to display planes.
+enum class HWCPlaneAllocation : int32_t {
+  kGreedy = 0,
+  kWholeConfig = 1,
+  kCostBased = 2,
+  kExhaustive = 3
+};
+
 }  // namespace hardware
 #endif  // HWC_DEFS_H_
@@ -65,6 +65,21 @@ struct HwcLayer {
     return display_frame_;
   }
 
+  // Bounding rectangle, in source buffer coordinates, of the content which
+  // changed since the previous Present. An empty rectangle means nothing
+  // changed. Only applies to the next Present; layers without surface damage
+  // are treated as fully damaged.
+  void SetSurfaceDamage(const HwcRect<int>& surface_damage);
+  const HwcRect<int>& GetSurfaceDamage() const {
+    return surface_damage_;
+  }
+
+  bool HasSurfaceDamage() const {
+    return has_surface_damage_;
+  }
+
+  void ResetSurfaceDamage();
+
  private:
   uint32_t transform_;
   uint32_t source_crop_width_;
@@ -74,6 +89,8 @@ struct HwcLayer {
   uint8_t alpha_ = 0xff;
   HwcRect<float> source_crop_;
   HwcRect<int> display_frame_;
+  HwcRect<int> surface_damage_ = HwcRect<int>(0, 0, 0, 0);
+  bool has_surface_damage_ = false;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   HWCNativeHandle sf_handle_ = 0;
 };
@@ -36,6 +36,18 @@ class NativeBufferHandler {
 
   virtual bool DestroyBuffer(HWCNativeHandle handle) = 0;
 
+  // Fills |bo| for |handle|. Buffers are only imported the first time they
+  // are seen, later calls return the import cached for the handle (see
+  // BufferImportCache) until the buffer is destroyed. The prime fd in |bo|
+  // stays owned by the buffer.
+  //
+  // Each import gets an id from BufferImportLog, which the handler reports
+  // to the log as released when the buffer is destroyed. Resources kept for
+  // a buffer across frames are keyed on it, as a new buffer may get the GEM
+  // handles of a destroyed one. Handlers which don't cache the import set
+  // it to 0, the buffer is then imported again every frame. If such an
+  // import opened a new prime fd, owns_prime_fd is set and the caller
+  // closes it.
   virtual bool ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) = 0;
 };
 
@@ -70,6 +70,19 @@ class NativeDisplay {
                                     uint32_t display_id) = 0;
   virtual void VSyncControl(bool enabled) = 0;
 
+  // Selects how layers are assigned to hardware planes. Returns false for
+  // displays which don't scan out from planes.
+  virtual bool SetPlaneAllocation(HWCPlaneAllocation /*allocation*/) {
+    return false;
+  }
+
+  // Moves the cursor to x, y without going through Present. Returns false
+  // if the cursor can't be moved on its own, in which case the next
+  // Present needs to pick up the new position.
+  virtual bool SetCursorPosition(int32_t /*x*/, int32_t /*y*/) {
+    return false;
+  }
+
   // Virtual display related.
   virtual void InitVirtualDisplay(uint32_t /*width*/, uint32_t /*height*/) {
   }
@@ -28,6 +28,10 @@ class SpinLock {
     }
   }
 
+  bool try_lock() {
+    return !atomic_lock_.test_and_set(std::memory_order_acquire);
+  }
+
   void unlock() {
     atomic_lock_.clear(std::memory_order_release);
   }
@@ -0,0 +1,420 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Drives DisplayPlaneManager (or InternalDisplay::Present with -p) against
+// the fake KMS device and reports how many ioctls and how much time every
+// plane allocation strategy needs per frame. Runs without a GPU, except
+// for -p which still needs sw_sync and an EGL implementation for frames
+// that end up GPU composited.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+#include <hwcdefs.h>
+#include <hwclayer.h>
+
+#include "displayplanemanager.h"
+#include "drmpropertyregistry.h"
+#include "drmscopedtypes.h"
+#include "internaldisplay.h"
+#include "nativesync.h"
+#include "overlaylayer.h"
+
+#include "fakekms/fakebufferhandler.h"
+#include "fakekms/fakekms.h"
+
+using hwcomposer::HWCBlending;
+using hwcomposer::HwcRect;
+
+// Heap allocations made by any thread, -p reports them per frame. These
+// include the fake KMS device's own bookkeeping on every commit and test
+// commit, which libdrm wouldn't do through operator new.
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+  allocations++;
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+struct Options {
+  uint32_t frames = 600;
+  uint32_t layers = 5;
+  uint32_t ioctl_latency_us = 0;
+  uint32_t test_commit_latency_us = 0;
+  uint32_t max_planes = 0;
+  bool static_stack = false;
+  bool present = false;
+  int strategy = -1;
+};
+
+struct LayerDesc {
+  uint32_t format;
+  HwcRect<int> frame;
+  uint32_t width;
+  uint32_t height;
+  HWCBlending blending;
+  uint8_t alpha;
+};
+
+class BenchDisplay : public hwcomposer::InternalDisplay {
+ public:
+  using InternalDisplay::InternalDisplay;
+  using InternalDisplay::Connect;
+};
+
+const char *kStrategyNames[] = {"greedy", "wholeconfig", "costbased",
+                                "exhaustive"};
+
+int64_t NowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// A desktop like stack: opaque wallpaper, a scaled video and translucent
+// windows on top of it.
+std::vector<LayerDesc> BuildStack(uint32_t count, uint32_t width,
+                                  uint32_t height) {
+  std::vector<LayerDesc> stack;
+  stack.push_back({DRM_FORMAT_XRGB8888,
+                   HwcRect<int>(0, 0, width, height), width, height,
+                   HWCBlending::kBlendingNone, 0xFF});
+  if (count > 1)
+    stack.push_back({DRM_FORMAT_NV12,
+                     HwcRect<int>(width / 8, height / 8, width * 5 / 8,
+                                  height * 5 / 8),
+                     1280, 720, HWCBlending::kBlendingNone, 0xFF});
+
+  for (uint32_t i = stack.size(); i < count; i++) {
+    int left = (i * 97) % (width / 2);
+    int top = (i * 53) % (height / 2);
+    stack.push_back({DRM_FORMAT_ARGB8888,
+                     HwcRect<int>(left, top, left + width / 3,
+                                  top + height / 3),
+                     width / 3, height / 3, HWCBlending::kBlendingPremult,
+                     static_cast<uint8_t>(i % 2 ? 0xFF : 0xC0)});
+  }
+
+  return stack;
+}
+
+// Cost of bringing up the planes of one CRTC, most of which is property
+// discovery.
+void PrintInit(int64_t elapsed_us) {
+  fakekms::Stats kms = fakekms::GetStats();
+  printf("init         %" PRId64 "us  ioctls %" PRIu64 "\n", elapsed_us,
+         kms.ioctls);
+}
+
+void MoveWindows(std::vector<LayerDesc> &stack, uint32_t frame,
+                 uint32_t width) {
+  for (size_t i = 2; i < stack.size(); i++) {
+    HwcRect<int> &rect = stack[i].frame;
+    int w = rect.right - rect.left;
+    rect.left = (rect.left + 4 + frame % 3) % (width - w);
+    rect.right = rect.left + w;
+  }
+}
+
+bool RunManager(const Options &options, int fd, uint32_t crtc_id,
+                hwcomposer::HWCPlaneAllocation allocation,
+                fakekms::FakeBufferHandler &handler) {
+  fakekms::Config config = fakekms::DefaultConfig(1);
+  hwcomposer::DrmPropertyRegistry registry(fd);
+  hwcomposer::DisplayPlaneManager manager(fd, 0, crtc_id);
+  fakekms::ResetStats();
+  int64_t init_start = NowUs();
+  if (!manager.Initialize(&handler, &registry, config.width, config.height)) {
+    fprintf(stderr, "Failed to initialize DisplayPlaneManager.\n");
+    return false;
+  }
+  manager.SetAllocationStrategy(allocation);
+  PrintInit(NowUs() - init_start);
+
+  std::vector<LayerDesc> stack =
+      BuildStack(options.layers, config.width, config.height);
+  std::vector<HWCNativeHandle> handles;
+  for (const LayerDesc &desc : stack) {
+    HWCNativeHandle handle;
+    handler.CreateBuffer(desc.width, desc.height, desc.format, &handle);
+    handles.push_back(handle);
+  }
+
+  // Only waited on for -EBUSY, which needs no timeline.
+  hwcomposer::NativeSync sync;
+  hwcomposer::DisplayPlaneStateList composition;
+  fakekms::ResetStats();
+  int64_t start = NowUs();
+  uint32_t failed = 0;
+  for (uint32_t frame = 0; frame < options.frames; frame++) {
+    if (!options.static_stack)
+      MoveWindows(stack, frame, config.width);
+
+    std::vector<hwcomposer::OverlayLayer> layers(stack.size());
+    for (size_t i = 0; i < stack.size(); i++) {
+      hwcomposer::OverlayLayer &layer = layers[i];
+      layer.SetNativeHandle(handles[i]);
+      layer.SetTransform(0);
+      layer.SetAlpha(stack[i].alpha);
+      layer.SetBlending(stack[i].blending);
+      layer.SetSourceCrop(
+          HwcRect<float>(0, 0, stack[i].width, stack[i].height));
+      layer.SetDisplayFrame(stack[i].frame);
+      layer.SetIndex(i);
+    }
+
+    bool needs_modeset = frame == 0;
+    if (!manager.BeginFrameUpdate(layers))
+      return false;
+
+    manager.ValidateLayers(layers, needs_modeset, composition);
+
+    hwcomposer::ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
+    hwcomposer::ScopedFd fence;
+    if (manager.CommitFrame(composition, pset.get(), needs_modeset, &sync,
+                            fence))
+      manager.EndFrameUpdate();
+    else
+      failed++;
+  }
+  int64_t elapsed = NowUs() - start;
+
+  const hwcomposer::PlaneAllocationStrategy::Stats &strategy_stats =
+      manager.GetAllocationStrategy()->GetStats();
+  const hwcomposer::DisplayPlaneManager::ValidationStats &validation =
+      manager.GetValidationStats();
+  fakekms::Stats kms = fakekms::GetStats();
+  printf("%-12s frames %u failed %u  %.1fus/frame  decision %.1fus/frame\n",
+         manager.GetAllocationStrategy()->Name(), options.frames, failed,
+         (double)elapsed / options.frames,
+         strategy_stats.frames
+             ? (double)strategy_stats.decision_time_us / strategy_stats.frames
+             : 0.0);
+  printf(
+      "             test commits %" PRIu64 " (%" PRIu64 " failed)  ioctls %" PRIu64
+      "  layout cache %" PRIu64 "/%" PRIu64 "  verdict cache %" PRIu64
+      "/%" PRIu64 "\n",
+      kms.test_commits, kms.failed_test_commits, kms.ioctls, validation.hits,
+      validation.hits + validation.misses, validation.verdict_hits,
+      validation.verdict_hits + validation.verdict_misses);
+
+  for (HWCNativeHandle handle : handles)
+    handler.DestroyBuffer(handle);
+
+  return true;
+}
+
+bool RunPresent(const Options &options, int fd, uint32_t crtc_id,
+                uint32_t connector_id, hwcomposer::HWCPlaneAllocation allocation,
+                fakekms::FakeBufferHandler &handler) {
+  hwcomposer::ScopedDrmConnectorPtr connector(
+      drmModeGetConnector(fd, connector_id));
+  if (!connector || !connector->count_modes)
+    return false;
+
+  hwcomposer::DrmPropertyRegistry registry(fd);
+  BenchDisplay display(fd, handler, registry, 0, crtc_id);
+  fakekms::ResetStats();
+  int64_t init_start = NowUs();
+  if (!display.Initialize() ||
+      !display.Connect(connector->modes[0], connector.get())) {
+    fprintf(stderr, "Failed to connect display.\n");
+    return false;
+  }
+  display.SetPlaneAllocation(allocation);
+  PrintInit(NowUs() - init_start);
+
+  std::vector<LayerDesc> stack =
+      BuildStack(options.layers, display.Width(), display.Height());
+  std::vector<HWCNativeHandle> handles;
+  for (const LayerDesc &desc : stack) {
+    HWCNativeHandle handle;
+    handler.CreateBuffer(desc.width, desc.height, desc.format, &handle);
+    handles.push_back(handle);
+  }
+
+  std::vector<hwcomposer::HwcLayer> layers(stack.size());
+  std::vector<hwcomposer::HwcLayer *> source_layers;
+  source_layers.reserve(stack.size());
+  fakekms::ResetStats();
+  int64_t start = NowUs();
+  uint32_t failed = 0;
+  // The first frames fill caches and scratch buffers, only later ones show
+  // what a steady state frame allocates.
+  uint32_t warm_up_frames = options.frames / 10;
+  uint64_t warm_up_allocations = 0;
+  for (uint32_t frame = 0; frame < options.frames; frame++) {
+    if (frame == warm_up_frames)
+      warm_up_allocations = allocations;
+
+    if (!options.static_stack)
+      MoveWindows(stack, frame, display.Width());
+
+    source_layers.clear();
+    for (size_t i = 0; i < stack.size(); i++) {
+      hwcomposer::HwcLayer &layer = layers[i];
+      layer.SetNativeHandle(handles[i]);
+      layer.SetTransform(0);
+      layer.SetAlpha(stack[i].alpha);
+      layer.SetBlending(stack[i].blending);
+      layer.SetSourceCrop(
+          HwcRect<float>(0, 0, stack[i].width, stack[i].height));
+      layer.SetDisplayFrame(stack[i].frame);
+      source_layers.push_back(&layer);
+    }
+
+    if (!display.Present(source_layers))
+      failed++;
+  }
+  int64_t elapsed = NowUs() - start;
+  uint64_t steady_allocations = allocations - warm_up_allocations;
+
+  fakekms::Stats kms = fakekms::GetStats();
+  printf("%-12s frames %u failed %u  %.1fus/frame  test commits %" PRIu64
+         "  ioctls %" PRIu64 "  properties/commit %.1f  framebuffers %" PRIu64
+         "  allocations/frame %.1f\n",
+         kStrategyNames[static_cast<int>(allocation)], options.frames, failed,
+         (double)elapsed / options.frames, kms.test_commits, kms.ioctls,
+         kms.commits ? (double)kms.committed_properties / kms.commits : 0.0,
+         kms.framebuffers_added,
+         (double)steady_allocations / (options.frames - warm_up_frames));
+
+  for (HWCNativeHandle handle : handles)
+    handler.DestroyBuffer(handle);
+
+  return true;
+}
+
+void Usage(const char *name) {
+  printf(
+      "Usage: %s [options]\n"
+      "  -f frames        number of frames to validate (default 600)\n"
+      "  -l layers        layers in the stack (default 5)\n"
+      "  -s strategy      greedy, wholeconfig, costbased or exhaustive\n"
+      "                   (default: all of them)\n"
+      "  -i us            latency added to every ioctl\n"
+      "  -t us            latency added to every test commit\n"
+      "  -m planes        max enabled planes accepted per CRTC\n"
+      "  -S               keep the layer stack static between frames\n"
+      "  -p               go through InternalDisplay::Present\n",
+      name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:l:s:i:t:m:Sph")) != -1) {
+    switch (opt) {
+      case 'f':
+        options.frames = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        options.layers = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        for (int i = 0; i < 4; i++) {
+          if (!strcmp(optarg, kStrategyNames[i]))
+            options.strategy = i;
+        }
+        if (options.strategy < 0) {
+          Usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'i':
+        options.ioctl_latency_us = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        options.test_commit_latency_us = strtoul(optarg, NULL, 0);
+        break;
+      case 'm':
+        options.max_planes = strtoul(optarg, NULL, 0);
+        break;
+      case 'S':
+        options.static_stack = true;
+        break;
+      case 'p':
+        options.present = true;
+        break;
+      default:
+        Usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!options.frames || !options.layers) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  fakekms::Config config = fakekms::DefaultConfig(1);
+  config.ioctl_latency_us = options.ioctl_latency_us;
+  config.test_commit_latency_us = options.test_commit_latency_us;
+  config.max_enabled_planes_per_crtc = options.max_planes;
+  fakekms::Configure(config);
+
+  hwcomposer::ScopedFd fd(drmOpen("i915", NULL));
+  drmSetClientCap(fd.get(), DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1);
+  drmSetClientCap(fd.get(), DRM_CLIENT_CAP_ATOMIC, 1);
+  hwcomposer::ScopedDrmResourcesPtr res(drmModeGetResources(fd.get()));
+  if (!res || !res->count_crtcs) {
+    fprintf(stderr, "Fake KMS device has no CRTCs.\n");
+    return 1;
+  }
+
+  fakekms::FakeBufferHandler handler;
+  for (int i = 0; i < 4; i++) {
+    if (options.strategy >= 0 && options.strategy != i)
+      continue;
+
+    hwcomposer::HWCPlaneAllocation allocation =
+        static_cast<hwcomposer::HWCPlaneAllocation>(i);
+    bool ret = options.present
+                   ? RunPresent(options, fd.get(), res->crtcs[0],
+                                res->connectors[0], allocation, handler)
+                   : RunManager(options, fd.get(), res->crtcs[0], allocation,
+                                handler);
+    if (!ret)
+      return 1;
+  }
+
+  return 0;
+}
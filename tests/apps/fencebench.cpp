@@ -0,0 +1,276 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures the release fence backends NativeSync can use: the cost of
+// creating a fence, of signaling a point and how long a thread waiting on
+// a fence takes to wake up once it was signaled. Also compares a new
+// timeline per frame with one timeline kept for all frames. Backends which
+// are not available here, i.e. sw_sync without debugfs access or syncobj
+// on an older kernel, are skipped.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "fencebackend.h"
+#include "nativesync.h"
+
+using hwcomposer::FenceBackend;
+using hwcomposer::NativeSync;
+
+namespace {
+
+struct Options {
+  uint32_t frames = 1000;
+  uint32_t layers = 5;
+  uint32_t waits = 200;
+  const char *device = "/dev/dri/renderD128";
+};
+
+struct Result {
+  double create_us = 0;
+  double signal_us = 0;
+  double wake_us = 0;
+  double frame_us = 0;
+  double timeline_per_frame_us = 0;
+};
+
+int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void CloseFences(std::vector<int> &fences) {
+  for (int fence : fences) {
+    if (fence >= 0)
+      close(fence);
+  }
+
+  fences.clear();
+}
+
+// Fence creation and signaling on their own, on one timeline.
+bool MeasureCreateAndSignal(FenceBackend::Type type, int gpu_fd,
+                            const Options &options, Result *result) {
+  std::unique_ptr<FenceBackend> backend(FenceBackend::Create(type, gpu_fd));
+  if (!backend)
+    return false;
+
+  std::vector<int> fences;
+  int64_t create_ns = 0;
+  int64_t signal_ns = 0;
+  for (uint32_t frame = 1; frame <= options.frames; frame++) {
+    int64_t start = NowNs();
+    for (uint32_t layer = 0; layer < options.layers; layer++)
+      fences.push_back(backend->CreateFence(frame));
+    int64_t created = NowNs();
+    backend->Signal(frame);
+    signal_ns += NowNs() - created;
+    create_ns += created - start;
+    CloseFences(fences);
+  }
+
+  result->create_us =
+      create_ns / 1000.0 / ((double)options.frames * options.layers);
+  result->signal_us = signal_ns / 1000.0 / options.frames;
+  return true;
+}
+
+// Time from signaling a point until a thread blocked on one of its fences
+// runs again.
+bool MeasureWake(FenceBackend::Type type, int gpu_fd, const Options &options,
+                 Result *result) {
+  std::unique_ptr<FenceBackend> backend(FenceBackend::Create(type, gpu_fd));
+  if (!backend)
+    return false;
+
+  std::atomic<int> fence(-1);
+  std::atomic<int64_t> woken(0);
+  std::atomic<bool> quit(false);
+  std::thread waiter([&]() {
+    while (!quit) {
+      int fd = fence.exchange(-1);
+      if (fd < 0) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      struct pollfd pfd = {fd, POLLIN, 0};
+      poll(&pfd, 1, 1000);
+      woken = NowNs();
+      close(fd);
+    }
+  });
+
+  int64_t wake_ns = 0;
+  bool succeeded = true;
+  for (uint32_t i = 1; i <= options.waits; i++) {
+    int fd = backend->CreateFence(i);
+    if (fd < 0) {
+      succeeded = false;
+      break;
+    }
+
+    woken = 0;
+    fence = fd;
+    // Give the waiter time to block in poll.
+    usleep(500);
+    int64_t signaled = NowNs();
+    backend->Signal(i);
+    while (!woken)
+      std::this_thread::yield();
+    wake_ns += woken - signaled;
+  }
+
+  quit = true;
+  waiter.join();
+  result->wake_us = wake_ns / 1000.0 / options.waits;
+  return succeeded;
+}
+
+// What a display pays per frame, one point per frame which is signaled
+// once the next frame is in.
+bool MeasurePersistentTimeline(FenceBackend::Type type, int gpu_fd,
+                               const Options &options, Result *result) {
+  std::vector<int> fences;
+  NativeSync sync;
+  int64_t start = NowNs();
+  if (!sync.Init(type, gpu_fd))
+    return false;
+
+  int64_t previous_point = 0;
+  for (uint32_t frame = 0; frame < options.frames; frame++) {
+    int64_t point = sync.ReserveTimelinePoint();
+    for (uint32_t layer = 0; layer < options.layers; layer++)
+      fences.push_back(sync.CreateTimelineFence(point));
+
+    sync.IncreaseTimelineToPoint(previous_point);
+    previous_point = point;
+    CloseFences(fences);
+  }
+  sync.SignalCompositionDone();
+
+  result->frame_us = (NowNs() - start) / 1000.0 / options.frames;
+  return true;
+}
+
+// A timeline is opened for every frame and torn down, signaling its
+// fences, once the next frame replaced it.
+bool MeasureTimelinePerFrame(FenceBackend::Type type, int gpu_fd,
+                             const Options &options, Result *result) {
+  std::vector<int> fences;
+  std::unique_ptr<NativeSync> previous;
+  int64_t start = NowNs();
+  for (uint32_t frame = 0; frame < options.frames; frame++) {
+    std::unique_ptr<NativeSync> sync(new NativeSync());
+    if (!sync->Init(type, gpu_fd))
+      return false;
+
+    for (uint32_t layer = 0; layer < options.layers; layer++)
+      fences.push_back(sync->CreateNextTimelineFence());
+
+    previous = std::move(sync);
+    CloseFences(fences);
+  }
+  previous.reset();
+
+  result->timeline_per_frame_us = (NowNs() - start) / 1000.0 / options.frames;
+  return true;
+}
+
+void Usage(const char *name) {
+  printf(
+      "Usage: %s [options]\n"
+      "  -f frames        number of frames (default 1000)\n"
+      "  -l layers        release fences per frame (default 5)\n"
+      "  -w waits         wake ups to measure (default 200)\n"
+      "  -d device        DRM device for syncobj (default %s)\n",
+      name, Options().device);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:l:w:d:")) != -1) {
+    switch (opt) {
+      case 'f':
+        options.frames = strtoul(optarg, NULL, 0);
+        break;
+      case 'l':
+        options.layers = strtoul(optarg, NULL, 0);
+        break;
+      case 'w':
+        options.waits = strtoul(optarg, NULL, 0);
+        break;
+      case 'd':
+        options.device = optarg;
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (!options.frames || !options.layers || !options.waits) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  int gpu_fd = open(options.device, O_RDWR | O_CLOEXEC);
+  if (gpu_fd < 0)
+    fprintf(stderr, "Failed to open %s, no syncobj.\n", options.device);
+
+  printf("%u frames, %u fences per frame, %u wake ups\n", options.frames,
+         options.layers, options.waits);
+  printf("%-10s %11s %11s %11s %11s %11s\n", "backend", "create us",
+         "signal us", "wake us", "frame us", "new tl us");
+  const FenceBackend::Type types[] = {FenceBackend::kSyncobj,
+                                      FenceBackend::kSwSync,
+                                      FenceBackend::kUserspace};
+  for (FenceBackend::Type type : types) {
+    Result result;
+    if (!MeasureCreateAndSignal(type, gpu_fd, options, &result) ||
+        !MeasureWake(type, gpu_fd, options, &result) ||
+        !MeasurePersistentTimeline(type, gpu_fd, options, &result) ||
+        !MeasureTimelinePerFrame(type, gpu_fd, options, &result)) {
+      printf("%-10s not available\n", FenceBackend::GetTypeName(type));
+      continue;
+    }
+
+    printf("%-10s %11.2f %11.2f %11.2f %11.2f %11.2f\n",
+           FenceBackend::GetTypeName(type), result.create_us,
+           result.signal_us, result.wake_us, result.frame_us,
+           result.timeline_per_frame_us);
+  }
+
+  if (gpu_fd >= 0)
+    close(gpu_fd);
+
+  return 0;
+}
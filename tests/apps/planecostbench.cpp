@@ -0,0 +1,132 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+
+// Checks that PlaneCostModel ranks layers the way plane allocation relies
+// on: a fullscreen video saves far more traffic on its own plane than a
+// small icon, which shouldn't get a plane at all, and translucent layers
+// cost more to composite than opaque ones. Then measures how long one
+// savings estimate takes, strategies run it for every layer each frame.
+// Exits with 1 if any of the checks fail.
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <drm_fourcc.h>
+
+#include "planecostmodel.h"
+
+using hwcomposer::HWCBlending;
+using hwcomposer::HwcRect;
+using hwcomposer::PlaneCostInput;
+using hwcomposer::PlaneCostModel;
+
+namespace {
+
+int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+PlaneCostInput MakeLayer(int width, int height, uint32_t format) {
+  PlaneCostInput layer;
+  layer.display_frame = HwcRect<int>(0, 0, width, height);
+  layer.source_crop = HwcRect<float>(0, 0, width, height);
+  layer.format = format;
+  return layer;
+}
+
+uint32_t Expect(bool condition, const char *what) {
+  if (condition)
+    return 0;
+
+  fprintf(stderr, "FAIL: %s\n", what);
+  return 1;
+}
+
+uint32_t Check() {
+  PlaneCostInput video = MakeLayer(1920, 1080, DRM_FORMAT_NV12);
+  PlaneCostInput icon = MakeLayer(48, 48, DRM_FORMAT_ARGB8888);
+  icon.blending = HWCBlending::kBlendingPremult;
+  PlaneCostInput faded = MakeLayer(1920, 1080, DRM_FORMAT_XRGB8888);
+  PlaneCostInput opaque = faded;
+  faded.alpha = 0x80;
+
+  int64_t video_savings = PlaneCostModel::GetOverlaySavings(video);
+  int64_t icon_savings = PlaneCostModel::GetOverlaySavings(icon);
+  printf("savings: fullscreen NV12 %lld bytes, 48x48 icon %lld bytes\n",
+         (long long)video_savings, (long long)icon_savings);
+
+  uint32_t failures = 0;
+  failures += Expect(video_savings > icon_savings,
+                     "fullscreen NV12 ranks below a 48x48 icon");
+  failures += Expect(video_savings > 0, "fullscreen NV12 isn't worth a plane");
+  failures += Expect(icon_savings < 0, "48x48 icon is worth a plane");
+  failures += Expect(PlaneCostModel::GetCompositionCost(faded) >
+                         PlaneCostModel::GetCompositionCost(opaque),
+                     "plane alpha doesn't add destination reads");
+  failures += Expect(PlaneCostModel::GetScanoutCost(video) <
+                         PlaneCostModel::GetScanoutCost(opaque),
+                     "NV12 scans out as much as XRGB");
+  return failures;
+}
+
+void Usage(const char *name) {
+  fprintf(stderr, "usage: %s [-i iterations]\n", name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  uint32_t iterations = 1000000;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:")) != -1) {
+    switch (opt) {
+      case 'i':
+        iterations = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (!iterations) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  uint32_t failures = Check();
+
+  PlaneCostInput layers[] = {MakeLayer(1920, 1080, DRM_FORMAT_NV12),
+                             MakeLayer(1280, 720, DRM_FORMAT_ARGB8888),
+                             MakeLayer(48, 48, DRM_FORMAT_ARGB8888),
+                             MakeLayer(640, 480, DRM_FORMAT_RGB565)};
+  const size_t count = sizeof(layers) / sizeof(layers[0]);
+  int64_t total = 0;
+  int64_t start = NowNs();
+  for (uint32_t i = 0; i < iterations; i++)
+    total += PlaneCostModel::GetOverlaySavings(layers[i % count]);
+  int64_t elapsed = NowNs() - start;
+  printf("%.2f ns per estimate (checksum %lld)\n",
+         (double)elapsed / iterations, (long long)total);
+
+  return failures ? 1 : 0;
+}
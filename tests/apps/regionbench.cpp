@@ -0,0 +1,434 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Checks get_draw_regions() against the original implementation on random
+// rect sets, then measures both for 4 to 64 overlapping rects. Compositor
+// runs it once per render plane on every frame. Sets of up to 256 rects,
+// which need the wide id sets and which the original implementation
+// couldn't handle, are checked and measured on their own. Last, the
+// number of regions before and after merge_draw_regions() is reported for
+// stacks with a layer on its own plane punched out, like Compositor does.
+// Exits with 1 if get_draw_regions() or merge_draw_regions() get the rects
+// covering any point wrong.
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "disjoint_layers.h"
+#include "drawregionsreference.h"
+
+using hwcomposer::DrawRegionsScratch;
+using hwcomposer::Rect;
+using hwcomposer::RectIDs;
+using hwcomposer::RectSet;
+using hwcomposer::WideDrawRegionsScratch;
+using hwcomposer::WideRectIDs;
+
+namespace {
+
+struct Options {
+  uint32_t checks = 2000;
+  uint32_t iterations = 2000;
+  uint32_t seed = 1;
+};
+
+typedef std::vector<Rect<int>> Rects;
+typedef std::vector<RectSet<int>> Regions;
+typedef std::vector<RectSet<int, WideRectIDs>> WideRegions;
+
+int64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Windows on a 1080p screen. A coarse |step| makes many edges coincide,
+// which is where sweep implementations tend to go wrong.
+Rects RandomRects(std::mt19937 &rng, size_t count, int step) {
+  std::uniform_int_distribution<int> x(0, 1920 / step);
+  std::uniform_int_distribution<int> y(0, 1080 / step);
+  Rects rects;
+  for (size_t i = 0; i < count; i++) {
+    int x1 = x(rng) * step;
+    int x2 = x(rng) * step;
+    int y1 = y(rng) * step;
+    int y2 = y(rng) * step;
+    // Keep a few empty and inverted ones, they have to be ignored.
+    if (rng() % 8)
+      rects.emplace_back(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2),
+                         std::max(y1, y2));
+    else
+      rects.emplace_back(x1, y1, x2, y2);
+  }
+
+  return rects;
+}
+
+bool Contains(const Rect<int> &rect, int x, int y) {
+  return x >= rect.left && x < rect.right && y >= rect.top && y < rect.bottom;
+}
+
+// Compares which rects cover every cell of the grid spanned by the edges of
+// |rects|, according to |regions| and to |rects| themselves. Regions must
+// not overlap. The first difference is reported if |name| is set.
+template <typename TIds>
+bool CheckCoverage(const Rects &rects,
+                   const std::vector<RectSet<int, TIds>> &regions,
+                   const char *name) {
+  std::vector<int> xs;
+  std::vector<int> ys;
+  for (const Rect<int> &rect : rects) {
+    xs.push_back(rect.left);
+    xs.push_back(rect.right);
+    ys.push_back(rect.top);
+    ys.push_back(rect.bottom);
+  }
+  std::sort(xs.begin(), xs.end());
+  std::sort(ys.begin(), ys.end());
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+  for (int x : xs) {
+    for (int y : ys) {
+      TIds expected;
+      for (size_t i = 0; i < rects.size(); i++) {
+        if (Contains(rects[i], x, y))
+          expected.add(i);
+      }
+
+      TIds found;
+      uint32_t hits = 0;
+      for (const RectSet<int, TIds> &region : regions) {
+        if (Contains(region.rect, x, y)) {
+          found = region.id_set;
+          hits++;
+        }
+      }
+
+      if (hits > 1 || !(found == expected)) {
+        if (name) {
+          // Only the lowest word which differs is printed.
+          size_t word = 0;
+          while (word + 1 < TIds::words &&
+                 found.getWord(word) == expected.getWord(word))
+            word++;
+          fprintf(stderr,
+                  "%s: at %d,%d %u regions, rects %zu+ %#llx instead of "
+                  "%#llx\n",
+                  name, x, y, hits, word * 64,
+                  (unsigned long long)found.getWord(word),
+                  (unsigned long long)expected.getWord(word));
+        }
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Finds the rects covering |x|, |y| according to |regions|. Returns false
+// if regions overlap there.
+bool FindCoverage(const Regions &regions, int x, int y, RectIDs *found) {
+  uint32_t hits = 0;
+  *found = RectIDs();
+  for (const RectSet<int> &region : regions) {
+    if (Contains(region.rect, x, y)) {
+      *found = region.id_set;
+      hits++;
+    }
+  }
+
+  return hits <= 1;
+}
+
+// Checks that |merged| covers every point with the same rects as |regions|.
+bool CheckSameCoverage(const Regions &regions, const Regions &merged) {
+  std::vector<int> xs;
+  std::vector<int> ys;
+  for (const RectSet<int> &region : regions) {
+    xs.push_back(region.rect.left);
+    xs.push_back(region.rect.right);
+    ys.push_back(region.rect.top);
+    ys.push_back(region.rect.bottom);
+  }
+  std::sort(xs.begin(), xs.end());
+  std::sort(ys.begin(), ys.end());
+  xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+  for (int x : xs) {
+    for (int y : ys) {
+      RectIDs expected;
+      RectIDs found;
+      if (!FindCoverage(regions, x, y, &expected) ||
+          !FindCoverage(merged, x, y, &found) || !(found == expected)) {
+        fprintf(stderr,
+                "merge_draw_regions: at %d,%d rects %#llx instead of %#llx\n",
+                x, y, (unsigned long long)found.getBits(),
+                (unsigned long long)expected.getBits());
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Treats rect |dedicated| as a layer on its own plane, with the rects
+// stacked in index order: it and everything below it is removed where it
+// is, like Compositor::SeparateLayers() does.
+void PunchOut(size_t dedicated, Regions *regions) {
+  for (RectSet<int> &region : *regions) {
+    if (!region.id_set.contains(dedicated))
+      continue;
+
+    for (size_t i = 0; i <= dedicated; i++)
+      region.id_set.subtract(i);
+  }
+
+  regions->erase(std::remove_if(regions->begin(), regions->end(),
+                                [](const RectSet<int> &region) {
+                                  return region.id_set.isEmpty();
+                                }),
+                 regions->end());
+}
+
+void PrintRects(const Rects &rects) {
+  for (const Rect<int> &rect : rects)
+    fprintf(stderr, "  {%d, %d, %d, %d},\n", rect.left, rect.top, rect.right,
+            rect.bottom);
+}
+
+// Runs both implementations on random rect sets. Where their coverage
+// differs the rects themselves decide: the original implementation tags
+// some regions with rects which don't cover them, mostly when edges
+// coincide, so only the new one has to match on every set. Returns the
+// number of sets it got wrong.
+uint32_t Check(const Options &options) {
+  std::mt19937 rng(options.seed);
+  DrawRegionsScratch scratch;
+  Regions regions;
+  Regions reference;
+  uint32_t failures = 0;
+  uint32_t reference_failures = 0;
+  const int steps[] = {1, 8, 120, 360};
+  for (uint32_t i = 0; i < options.checks; i++) {
+    size_t count = 1 + rng() % RectIDs::max_elements;
+    Rects rects = RandomRects(rng, count, steps[i % 4]);
+    regions.clear();
+    reference.clear();
+    hwcomposer::get_draw_regions(rects, &scratch, &regions);
+    hwcomposer::get_draw_regions_reference(rects, &reference);
+    if (!CheckCoverage(rects, reference, NULL))
+      reference_failures++;
+
+    if (!CheckCoverage(rects, regions, "get_draw_regions")) {
+      PrintRects(rects);
+      failures++;
+      continue;
+    }
+
+    Regions merged = regions;
+    PunchOut(count / 2, &regions);
+    PunchOut(count / 2, &merged);
+    hwcomposer::merge_draw_regions(&merged);
+    if (!CheckSameCoverage(regions, merged)) {
+      PrintRects(rects);
+      failures++;
+    }
+  }
+
+  printf("%u random rect sets: %u wrong, %u wrong in the reference\n",
+         options.checks, failures, reference_failures);
+  return failures;
+}
+
+// Sets of 65 to 256 rects, on the wide id sets. The grid check is
+// quadratic in the number of edges, so fewer sets are checked.
+uint32_t CheckWide(const Options &options) {
+  std::mt19937 rng(options.seed);
+  WideDrawRegionsScratch scratch;
+  WideRegions regions;
+  uint32_t failures = 0;
+  uint32_t checks = std::max(options.checks / 20, 1u);
+  const int steps[] = {1, 8, 120, 360};
+  for (uint32_t i = 0; i < checks; i++) {
+    size_t count = RectIDs::max_elements + 1 + rng() % 192;
+    Rects rects = RandomRects(rng, count, steps[i % 4]);
+    regions.clear();
+    hwcomposer::get_draw_regions(rects, &scratch, &regions);
+    if (!CheckCoverage(rects, regions, "wide get_draw_regions")) {
+      PrintRects(rects);
+      failures++;
+    }
+  }
+
+  printf("%u random sets of more than %d rects: %u wrong\n", checks,
+         RectIDs::max_elements, failures);
+  return failures;
+}
+
+// Returns the time per call, in nanoseconds.
+template <typename TRegions = Regions, typename Function>
+double Measure(const std::vector<Rects> &sets, uint32_t iterations,
+               Function function) {
+  TRegions regions;
+  int64_t start = NowNs();
+  for (uint32_t i = 0; i < iterations; i++) {
+    regions.clear();
+    function(sets[i % sets.size()], &regions);
+  }
+
+  return (NowNs() - start) / (double)iterations;
+}
+
+void Usage(const char *name) {
+  printf(
+      "Usage: %s [options]\n"
+      "  -c checks        random rect sets to compare (default 2000)\n"
+      "  -i iterations    calls per measurement (default 2000)\n"
+      "  -s seed          random seed (default 1)\n",
+      name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:i:s:")) != -1) {
+    switch (opt) {
+      case 'c':
+        options.checks = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        options.iterations = strtoul(optarg, NULL, 0);
+        break;
+      case 's':
+        options.seed = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (!options.iterations) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  uint32_t failures = Check(options);
+  failures += CheckWide(options);
+
+  printf("%-6s %14s %14s %14s %9s\n", "rects", "reference ns", "flat ns",
+         "scratch ns", "regions");
+  std::mt19937 rng(options.seed);
+  DrawRegionsScratch scratch;
+  for (size_t count : {4, 8, 16, 32, 64}) {
+    std::vector<Rects> sets;
+    for (int i = 0; i < 64; i++)
+      sets.push_back(RandomRects(rng, count, 1));
+
+    double reference = Measure(sets, options.iterations,
+                               hwcomposer::get_draw_regions_reference);
+    double flat = Measure(sets, options.iterations,
+                          [](const Rects &in, Regions *out) {
+      hwcomposer::get_draw_regions(in, out);
+    });
+    double reused = Measure(sets, options.iterations,
+                            [&scratch](const Rects &in, Regions *out) {
+      hwcomposer::get_draw_regions(in, &scratch, out);
+    });
+
+    size_t regions = 0;
+    for (const Rects &rects : sets) {
+      Regions out;
+      hwcomposer::get_draw_regions(rects, &out);
+      regions += out.size();
+    }
+
+    printf("%-6zu %14.0f %14.0f %14.0f %9.1f\n", count, reference, flat,
+           reused, regions / (double)sets.size());
+  }
+
+  // Only the wide id sets take these.
+  WideDrawRegionsScratch wide_scratch;
+  for (size_t count : {64, 128, 256}) {
+    std::vector<Rects> sets;
+    for (int i = 0; i < 16; i++)
+      sets.push_back(RandomRects(rng, count, 1));
+
+    double wide = Measure<WideRegions>(
+        sets, options.iterations,
+        [&wide_scratch](const Rects &in, WideRegions *out) {
+      hwcomposer::get_draw_regions(in, &wide_scratch, out);
+    });
+
+    size_t regions = 0;
+    for (const Rects &rects : sets) {
+      WideRegions out;
+      hwcomposer::get_draw_regions(rects, &wide_scratch, &out);
+      regions += out.size();
+    }
+
+    printf("%-6zu %14s %14s %14.0f %9.1f  (wide)\n", count, "-", "-", wide,
+           regions / (double)sets.size());
+  }
+
+  // Every region is drawn on its own, so merging saves draw calls. The
+  // stacks have a full screen layer at the bottom.
+  printf("\n%-6s %14s %14s %14s\n", "rects", "punched out", "merged",
+         "merge ns");
+  for (size_t count : {2, 4, 8, 16, 32, 64}) {
+    std::vector<Regions> sets;
+    size_t punched = 0;
+    size_t merged = 0;
+    for (int i = 0; i < 64; i++) {
+      Rects rects = RandomRects(rng, count - 1, 8);
+      rects.insert(rects.begin(), Rect<int>(0, 0, 1920, 1080));
+      Regions regions;
+      hwcomposer::get_draw_regions(rects, &scratch, &regions);
+      PunchOut(count / 2, &regions);
+      punched += regions.size();
+      sets.push_back(regions);
+      hwcomposer::merge_draw_regions(&regions);
+      merged += regions.size();
+    }
+
+    Regions regions;
+    int64_t start = NowNs();
+    for (uint32_t i = 0; i < options.iterations; i++) {
+      regions = sets[i % sets.size()];
+      hwcomposer::merge_draw_regions(&regions);
+    }
+    double merge = (NowNs() - start) / (double)options.iterations;
+
+    printf("%-6zu %14.1f %14.1f %14.0f\n", count,
+           punched / (double)sets.size(), merged / (double)sets.size(),
+           merge);
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Draws full screen regions with the generic composition program and with
+// the variant specialized for the same layers, and reports the GPU cost
+// per pixel of both. Needs an EGL implementation which supports
+// EGL_KHR_gl_texture_2D_image, no display is used.
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "egloffscreencontext.h"
+#include "glprogram.h"
+#include "renderstate.h"
+#include "shim.h"
+
+using hwcomposer::GLProgram;
+using hwcomposer::GLProgramVariant;
+using hwcomposer::RenderState;
+
+namespace {
+
+struct Options {
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  uint32_t iterations = 200;
+};
+
+struct Case {
+  const char *name;
+  GLProgramVariant variant;
+};
+
+uint64_t NowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Sources are external textures, like the buffers hwcomposer composes.
+struct SourceTexture {
+  GLuint texture_2d = 0;
+  GLuint external = 0;
+  EGLImageKHR image = EGL_NO_IMAGE_KHR;
+};
+
+bool CreateSource(EGLDisplay display, EGLContext context, uint32_t width,
+                  uint32_t height, uint8_t alpha, SourceTexture *source) {
+  std::vector<uint32_t> pixels(width * height);
+  for (uint32_t y = 0; y < height; y++)
+    for (uint32_t x = 0; x < width; x++)
+      pixels[y * width + x] =
+          (alpha << 24) | ((x ^ y) & 0xff) << 8 | (x & 0xff);
+
+  glGenTextures(1, &source->texture_2d);
+  glBindTexture(GL_TEXTURE_2D, source->texture_2d);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  source->image = eglCreateImageKHR(
+      display, context, EGL_GL_TEXTURE_2D_KHR,
+      (EGLClientBuffer)(uintptr_t)source->texture_2d, NULL);
+  if (source->image == EGL_NO_IMAGE_KHR)
+    return false;
+
+  glGenTextures(1, &source->external);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, source->external);
+  glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                               (GLeglImageOES)source->image);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+  return true;
+}
+
+void BuildState(const Options &options, const GLProgramVariant &variant,
+                const std::vector<SourceTexture> &sources, RenderState *state) {
+  state->x_ = 0;
+  state->y_ = 0;
+  state->width_ = options.width;
+  state->height_ = options.height;
+  for (size_t i = 0; i < variant.size(); i++) {
+    uint8_t bits = variant[i];
+    RenderState::LayerState src;
+    src.crop_bounds_[0] = src.crop_bounds_[1] = 0.0f;
+    src.crop_bounds_[2] = src.crop_bounds_[3] = 1.0f;
+    src.opaque_ = bits & hwcomposer::kVariantOpaque;
+    src.swap_xy_ = bits & hwcomposer::kVariantSwapXY;
+    std::copy_n(&hwcomposer::TransformMatrices[src.swap_xy_ ? 4 : 0], 4,
+                src.texture_matrix_);
+    src.alpha_ = (bits & hwcomposer::kVariantPlaneAlpha) ? 0.5f : 1.0f;
+    src.premult_ = (bits & hwcomposer::kVariantCoverage) ? 0.0f : 1.0f;
+    src.handle_ = sources[i].external;
+    state->layer_state_.push_back(src);
+  }
+}
+
+// Returns the GPU time per pixel, in nanoseconds.
+double Measure(const Options &options, GLProgram *program,
+               const RenderState &state) {
+  program->UseProgram(state, options.width, options.height);
+  // Warm up, the first draw may still compile.
+  glDrawArrays(GL_TRIANGLES, 0, 6);
+  glFinish();
+
+  uint64_t start = NowNs();
+  for (uint32_t i = 0; i < options.iterations; i++)
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+  glFinish();
+  uint64_t elapsed = NowNs() - start;
+
+  return elapsed / (double)options.iterations /
+         (options.width * (double)options.height);
+}
+
+void Usage(const char *name) {
+  printf(
+      "Usage: %s [-w width] [-h height] [-i iterations]\n"
+      "Compares the generic composition program with the specialized\n"
+      "variants for a few common layer stacks.\n",
+      name);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Options options;
+  int opt;
+  while ((opt = getopt(argc, argv, "w:h:i:")) != -1) {
+    switch (opt) {
+      case 'w':
+        options.width = strtoul(optarg, NULL, 0);
+        break;
+      case 'h':
+        options.height = strtoul(optarg, NULL, 0);
+        break;
+      case 'i':
+        options.iterations = strtoul(optarg, NULL, 0);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (!options.width || !options.height || !options.iterations) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  hwcomposer::EGLOffScreenContext context;
+  if (!context.Init(EGL_NO_CONTEXT) || !context.MakeCurrent()) {
+    fprintf(stderr, "Failed to create an EGL context.\n");
+    return 1;
+  }
+
+  hwcomposer::InitializeShims();
+
+  const uint8_t kOpaque = hwcomposer::kVariantOpaque;
+  const uint8_t kCoverage = hwcomposer::kVariantCoverage;
+  const uint8_t kPlaneAlpha = hwcomposer::kVariantPlaneAlpha;
+  const uint8_t kSwapXY = hwcomposer::kVariantSwapXY;
+  // Topmost layer first, like RenderState.
+  const std::vector<Case> cases = {
+      {"opaque", {kOpaque}},
+      {"premult over opaque", {0, kOpaque}},
+      {"rotated opaque", {kSwapXY | kOpaque}},
+      {"premult alpha, premult, opaque", {kPlaneAlpha, 0, kOpaque}},
+      {"coverage over 3 premult", {kCoverage, 0, 0, 0}},
+      {"4 premult alpha",
+       {kPlaneAlpha, kPlaneAlpha, kPlaneAlpha, kPlaneAlpha}},
+  };
+
+  size_t max_layers = 0;
+  for (const Case &test : cases)
+    max_layers = std::max(max_layers, test.variant.size());
+
+  std::vector<SourceTexture> sources(max_layers);
+  for (size_t i = 0; i < max_layers; i++) {
+    // Translucent on top, so the early outs of the generic program don't
+    // skip the lower layers.
+    uint8_t alpha = i + 1 == max_layers ? 0xff : 0x80;
+    if (!CreateSource(context.GetDisplay(), context.GetContext(),
+                      options.width, options.height, alpha, &sources[i])) {
+      fprintf(stderr, "Failed to create source textures.\n");
+      return 1;
+    }
+  }
+
+  GLuint target;
+  glGenTextures(1, &target);
+  glBindTexture(GL_TEXTURE_2D, target);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, options.width, options.height, 0,
+               GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  GLuint framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         target, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Render target is incomplete.\n");
+    return 1;
+  }
+
+  // One full screen quad, in the viewport coordinates GLRenderer uses.
+  // clang-format off
+  const GLfloat verts[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
+                           0.0f, 1.0f, 1.0f, 0.0f, 1.0f, 1.0f};
+  // clang-format on
+  GLuint vertex_array;
+  glGenVertexArraysOES(1, &vertex_array);
+  glBindVertexArrayOES(vertex_array);
+  GLuint vertex_buffer;
+  glGenBuffers(1, &vertex_buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, NULL);
+  glViewport(0, 0, options.width, options.height);
+
+  printf("%ux%u, %u draws per program\n", options.width, options.height,
+         options.iterations);
+  printf("%-34s %12s %12s %8s\n", "layers", "generic ns/px", "variant ns/px",
+         "speedup");
+  for (const Case &test : cases) {
+    RenderState state;
+    BuildState(options, test.variant, sources, &state);
+
+    GLProgram generic;
+    GLProgram variant;
+    if (!generic.Init(test.variant.size()) || !variant.Init(test.variant)) {
+      fprintf(stderr, "Failed to build programs for %s.\n", test.name);
+      return 1;
+    }
+
+    double generic_ns = Measure(options, &generic, state);
+    double variant_ns = Measure(options, &variant, state);
+    printf("%-34s %12.4f %12.4f %7.2fx\n", test.name, generic_ns, variant_ns,
+           variant_ns > 0 ? generic_ns / variant_ns : 0.0);
+  }
+
+  glDeleteBuffers(1, &vertex_buffer);
+  glDeleteVertexArraysOES(1, &vertex_array);
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteTextures(1, &target);
+  for (SourceTexture &source : sources) {
+    glDeleteTextures(1, &source.external);
+    eglDestroyImageKHR(context.GetDisplay(), source.image);
+    glDeleteTextures(1, &source.texture_2d);
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef DRAW_REGIONS_REFERENCE_H_
+#define DRAW_REGIONS_REFERENCE_H_
+
+#include <vector>
+
+#include "disjoint_layers.h"
+
+namespace hwcomposer {
+
+// The original implementation of get_draw_regions().
+void get_draw_regions_reference(const std::vector<Rect<int>> &in,
+                                std::vector<RectSet<int>> *out);
+
+}  // namespace hwcomposer
+#endif  // DRAW_REGIONS_REFERENCE_H_
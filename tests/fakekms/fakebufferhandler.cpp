@@ -0,0 +1,111 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "fakebufferhandler.h"
+
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+
+#include <hwcbuffer.h>
+
+namespace fakekms {
+
+static uint32_t BytesPerPixel(uint32_t format) {
+  switch (format) {
+    case DRM_FORMAT_RGB565:
+    case DRM_FORMAT_YUYV:
+    case DRM_FORMAT_UYVY:
+      return 2;
+    case DRM_FORMAT_NV12:
+    case DRM_FORMAT_YVU420:
+    case DRM_FORMAT_YUV420:
+      return 1;
+    default:
+      return 4;
+  }
+}
+
+FakeBufferHandler::FakeBufferHandler() : next_gem_handle_(1) {
+}
+
+FakeBufferHandler::~FakeBufferHandler() {
+}
+
+bool FakeBufferHandler::CreateBuffer(uint32_t w, uint32_t h, int format,
+                                     HWCNativeHandle *handle) {
+  struct gbm_handle *temp = new struct gbm_handle();
+  uint32_t fourcc = format ? format : DRM_FORMAT_XRGB8888;
+  temp->import_data.width = w;
+  temp->import_data.height = h;
+  temp->import_data.format = fourcc;
+  temp->import_data.fds[0] = eventfd(0, EFD_CLOEXEC);
+  temp->import_data.strides[0] = ((w * BytesPerPixel(fourcc)) + 63) & ~63;
+  temp->import_data.offsets[0] = 0;
+  if (fourcc == DRM_FORMAT_NV12) {
+    temp->import_data.strides[1] = temp->import_data.strides[0];
+    temp->import_data.offsets[1] = temp->import_data.strides[0] * h;
+  }
+  // Never dereferenced, only marks the handle as allocated.
+  temp->bo = reinterpret_cast<struct gbm_bo *>(
+      static_cast<uintptr_t>(next_gem_handle_++));
+  *handle = temp;
+
+  return temp->import_data.fds[0] >= 0;
+}
+
+bool FakeBufferHandler::DestroyBuffer(HWCNativeHandle handle) {
+  if (!handle)
+    return false;
+
+  import_cache_.Evict(handle);
+  if (handle->import_data.fds[0] >= 0)
+    close(handle->import_data.fds[0]);
+  delete handle;
+  return true;
+}
+
+bool FakeBufferHandler::ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) {
+  if (!handle || !handle->bo)
+    return false;
+
+  // The stand-in fds all share the eventfd inode, so they can't tell
+  // buffers apart. Handles are only freed through DestroyBuffer anyway.
+  if (import_cache_.Lookup(handle, 0, bo))
+    return true;
+
+  memset(bo, 0, sizeof(struct HwcBuffer));
+
+  uint32_t gem_handle = reinterpret_cast<uintptr_t>(handle->bo);
+  bo->width = handle->import_data.width;
+  bo->height = handle->import_data.height;
+  bo->format = handle->import_data.format;
+  bo->prime_fd = handle->import_data.fds[0];
+  for (size_t i = 0; i < 4; i++) {
+    if (!handle->import_data.strides[i])
+      break;
+    bo->gem_handles[i] = gem_handle;
+    bo->offsets[i] = handle->import_data.offsets[i];
+    bo->pitches[i] = handle->import_data.strides[i];
+  }
+
+  import_cache_.Insert(handle, 0, bo);
+  return true;
+}
+
+}  // namespace fakekms
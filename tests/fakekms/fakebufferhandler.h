@@ -0,0 +1,45 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef FAKE_BUFFER_HANDLER_H_
+#define FAKE_BUFFER_HANDLER_H_
+
+#include <nativebufferhandler.h>
+
+#include <bufferimportcache.h>
+
+namespace fakekms {
+
+// Hands out gbm_handles which are never backed by a gbm_bo. Every buffer
+// gets an unique GEM handle and a stand-in prime fd, which is all the
+// fake KMS device needs to create framebuffers.
+class FakeBufferHandler : public hwcomposer::NativeBufferHandler {
+ public:
+  FakeBufferHandler();
+  ~FakeBufferHandler() override;
+
+  bool CreateBuffer(uint32_t w, uint32_t h, int format,
+                    HWCNativeHandle *handle) override;
+  bool DestroyBuffer(HWCNativeHandle handle) override;
+  bool ImportBuffer(HWCNativeHandle handle, HwcBuffer *bo) override;
+
+ private:
+  uint32_t next_gem_handle_;
+  hwcomposer::BufferImportCache import_cache_;
+};
+
+}  // namespace fakekms
+#endif  // FAKE_BUFFER_HANDLER_H_
@@ -0,0 +1,1009 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "fakekms.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <set>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+#include <xf86drmMode.h>
+
+// libdrm keeps the layout of the atomic request private.
+struct _drmModeAtomicReq {
+  struct Item {
+    uint32_t object_id;
+    uint32_t property_id;
+    uint64_t value;
+  };
+  std::vector<Item> items;
+};
+
+namespace fakekms {
+
+namespace {
+
+const int64_t kOneSecondNs = 1000 * 1000 * 1000;
+// DRM_MODE_ROTATE_0, not available in older libdrm headers.
+const uint64_t kRotate0 = 1;
+
+struct Object {
+  uint32_t type;
+  // Property id to current value, in creation order.
+  std::vector<std::pair<uint32_t, uint64_t>> properties;
+
+  bool Find(uint32_t property_id, size_t *index) const {
+    for (size_t i = 0; i < properties.size(); i++) {
+      if (properties[i].first == property_id) {
+        *index = i;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+struct Crtc {
+  uint32_t id;
+  uint32_t encoder_id;
+  uint32_t connector_id;
+  int64_t flip_pending_until = 0;
+};
+
+struct Plane {
+  uint32_t id;
+  PlaneConfig config;
+};
+
+struct FrameBuffer {
+  uint32_t width;
+  uint32_t height;
+  uint32_t format;
+};
+
+struct PageFlipEvent {
+  int64_t due_ns;
+  uint32_t sequence;
+  uint32_t crtc_id;
+  void *user_data;
+};
+
+struct Device {
+  Config config;
+  Stats stats;
+  uint32_t next_id = 1;
+  std::map<uint32_t, Object> objects;
+  std::map<std::string, uint32_t> property_ids;
+  std::map<uint32_t, std::string> property_names;
+  std::vector<Crtc> crtcs;
+  std::vector<Plane> planes;
+  std::map<uint32_t, FrameBuffer> framebuffers;
+  std::map<uint32_t, std::vector<uint8_t>> blobs;
+  std::vector<PageFlipEvent> events;
+  std::set<int> fds;
+  int event_write_fd = -1;
+  int64_t start_ns = 0;
+  drmModeModeInfo mode;
+  bool configured = false;
+};
+
+std::mutex lock_;
+Device device_;
+
+int64_t Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * kOneSecondNs + ts.tv_nsec;
+}
+
+void SleepUntil(int64_t deadline_ns) {
+  struct timespec ts;
+  ts.tv_sec = deadline_ns / kOneSecondNs;
+  ts.tv_nsec = deadline_ns % kOneSecondNs;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+  }
+}
+
+int64_t VBlankPeriod() {
+  return kOneSecondNs / device_.config.refresh;
+}
+
+uint32_t VBlankSequence(int64_t now) {
+  return (now - device_.start_ns) / VBlankPeriod();
+}
+
+int64_t VBlankTime(uint32_t sequence) {
+  return device_.start_ns + sequence * VBlankPeriod();
+}
+
+// Accounts one ioctl and blocks for the configured latency. Must be
+// called without lock_ held.
+void SimulateIoctl(uint32_t extra_latency_us) {
+  uint32_t latency_us;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    device_.stats.ioctls++;
+    latency_us = device_.config.ioctl_latency_us + extra_latency_us;
+  }
+
+  if (latency_us)
+    SleepUntil(Now() + (int64_t)latency_us * 1000);
+}
+
+int Fail(int error) {
+  errno = error;
+  return -error;
+}
+
+uint32_t AddProperty(const char *name) {
+  auto it = device_.property_ids.find(name);
+  if (it != device_.property_ids.end())
+    return it->second;
+
+  uint32_t id = device_.next_id++;
+  device_.property_ids[name] = id;
+  device_.property_names[id] = name;
+  return id;
+}
+
+uint32_t AddObject(uint32_t type) {
+  uint32_t id = device_.next_id++;
+  device_.objects[id].type = type;
+  return id;
+}
+
+void AttachProperty(uint32_t object_id, const char *name, uint64_t value) {
+  device_.objects[object_id].properties.emplace_back(AddProperty(name), value);
+}
+
+bool GetValue(const Object &object, const char *name, uint64_t *value) {
+  auto it = device_.property_ids.find(name);
+  size_t index;
+  if (it == device_.property_ids.end() || !object.Find(it->second, &index))
+    return false;
+
+  *value = object.properties[index].second;
+  return true;
+}
+
+void BuildMode(uint32_t width, uint32_t height, uint32_t refresh,
+               drmModeModeInfo *mode) {
+  memset(mode, 0, sizeof(*mode));
+  mode->hdisplay = width;
+  mode->hsync_start = width + 48;
+  mode->hsync_end = width + 80;
+  mode->htotal = width + 160;
+  mode->vdisplay = height;
+  mode->vsync_start = height + 3;
+  mode->vsync_end = height + 8;
+  mode->vtotal = height + 45;
+  mode->vrefresh = refresh;
+  mode->clock = (uint64_t)mode->htotal * mode->vtotal * refresh / 1000;
+  mode->type = DRM_MODE_TYPE_PREFERRED | DRM_MODE_TYPE_DRIVER;
+  snprintf(mode->name, DRM_DISPLAY_MODE_LEN, "%ux%u", width, height);
+}
+
+void BuildDevice(const Config &config) {
+  if (device_.event_write_fd >= 0)
+    close(device_.event_write_fd);
+
+  device_ = Device();
+  device_.config = config;
+  if (!device_.config.refresh)
+    device_.config.refresh = 60;
+
+  BuildMode(config.width, config.height, device_.config.refresh,
+            &device_.mode);
+
+  for (uint32_t i = 0; i < config.num_crtcs; i++) {
+    // CRTCs come up lit by firmware, with the encoder and connector
+    // already routed to them.
+    uint32_t mode_blob = device_.next_id++;
+    const uint8_t *mode = reinterpret_cast<const uint8_t *>(&device_.mode);
+    device_.blobs[mode_blob].assign(mode, mode + sizeof(device_.mode));
+
+    Crtc crtc;
+    crtc.id = AddObject(DRM_MODE_OBJECT_CRTC);
+    AttachProperty(crtc.id, "ACTIVE", 1);
+    AttachProperty(crtc.id, "MODE_ID", mode_blob);
+    AttachProperty(crtc.id, "OUT_FENCE_PTR", 0);
+
+    crtc.encoder_id = AddObject(DRM_MODE_OBJECT_ENCODER);
+    crtc.connector_id = AddObject(DRM_MODE_OBJECT_CONNECTOR);
+    AttachProperty(crtc.connector_id, "DPMS", DRM_MODE_DPMS_ON);
+    AttachProperty(crtc.connector_id, "CRTC_ID", crtc.id);
+    device_.crtcs.emplace_back(crtc);
+  }
+
+  for (const PlaneConfig &plane_config : config.planes) {
+    Plane plane;
+    plane.id = AddObject(DRM_MODE_OBJECT_PLANE);
+    plane.config = plane_config;
+    AttachProperty(plane.id, "type", plane_config.type);
+    static const char *kPlaneProperties[] = {
+        "CRTC_ID", "FB_ID", "CRTC_X", "CRTC_Y", "CRTC_W",
+        "CRTC_H",  "SRC_X", "SRC_Y",  "SRC_W",  "SRC_H"};
+    for (const char *name : kPlaneProperties)
+      AttachProperty(plane.id, name, 0);
+
+    if (plane_config.has_rotation)
+      AttachProperty(plane.id, "rotation", kRotate0);
+
+    if (plane_config.has_alpha)
+      AttachProperty(plane.id, "alpha", 0xFF);
+
+    AttachProperty(plane.id, "IN_FENCE_FD", (uint64_t)-1);
+    device_.planes.emplace_back(plane);
+  }
+
+  device_.start_ns = Now();
+  device_.configured = true;
+}
+
+void EnsureConfigured() {
+  if (!device_.configured)
+    BuildDevice(DefaultConfig(1));
+}
+
+const Plane *FindPlane(uint32_t plane_id) {
+  for (const Plane &plane : device_.planes) {
+    if (plane.id == plane_id)
+      return &plane;
+  }
+  return NULL;
+}
+
+Crtc *FindCrtc(uint32_t crtc_id) {
+  for (Crtc &crtc : device_.crtcs) {
+    if (crtc.id == crtc_id)
+      return &crtc;
+  }
+  return NULL;
+}
+
+int CrtcPipe(uint32_t crtc_id) {
+  for (size_t i = 0; i < device_.crtcs.size(); i++) {
+    if (device_.crtcs[i].id == crtc_id)
+      return i;
+  }
+  return -1;
+}
+
+std::vector<PlaneState> CollectPlanes(
+    const std::map<uint32_t, Object> &objects) {
+  std::vector<PlaneState> planes;
+  for (const Plane &plane : device_.planes) {
+    planes.emplace_back();
+    PlaneState &state = planes.back();
+    state.plane_id = plane.id;
+    state.type = plane.config.type;
+    for (const auto &property : objects.at(plane.id).properties)
+      state.properties[device_.property_names[property.first]] =
+          property.second;
+  }
+  return planes;
+}
+
+// The subset of drm_atomic_check_only which matters to hwcomposer.
+int CheckState(const std::map<uint32_t, Object> &objects,
+               const AtomicState &state, bool modeset_changed) {
+  if (modeset_changed && !(state.flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+    return -EINVAL;
+
+  std::map<uint32_t, uint32_t> enabled_per_crtc;
+  for (const PlaneState &plane_state : state.planes) {
+    if (!plane_state.IsEnabled())
+      continue;
+
+    const Plane *plane = FindPlane(plane_state.plane_id);
+    uint32_t crtc_id = plane_state.Get("CRTC_ID");
+    int pipe = CrtcPipe(crtc_id);
+    if (pipe < 0 || !(plane->config.possible_crtcs & (1 << pipe)))
+      return -EINVAL;
+
+    uint64_t active = 0;
+    GetValue(objects.at(crtc_id), "ACTIVE", &active);
+    if (!active)
+      return -EINVAL;
+
+    auto fb = device_.framebuffers.find(plane_state.Get("FB_ID"));
+    if (fb == device_.framebuffers.end())
+      return -ENOENT;
+
+    bool format_supported = false;
+    for (uint32_t format : plane->config.formats)
+      format_supported |= format == fb->second.format;
+
+    if (!format_supported)
+      return -EINVAL;
+
+    uint64_t src_w = plane_state.Get("SRC_W") >> 16;
+    uint64_t src_h = plane_state.Get("SRC_H") >> 16;
+    if ((plane_state.Get("SRC_X") >> 16) + src_w > fb->second.width ||
+        (plane_state.Get("SRC_Y") >> 16) + src_h > fb->second.height)
+      return -ENOSPC;
+
+    if (!device_.config.allow_overlay_scaling &&
+        plane->config.type != DRM_PLANE_TYPE_PRIMARY &&
+        (src_w != plane_state.Get("CRTC_W") ||
+         src_h != plane_state.Get("CRTC_H")))
+      return -ERANGE;
+
+    enabled_per_crtc[crtc_id]++;
+  }
+
+  if (device_.config.max_enabled_planes_per_crtc) {
+    for (const auto &crtc : enabled_per_crtc) {
+      if (crtc.second > device_.config.max_enabled_planes_per_crtc)
+        return -EINVAL;
+    }
+  }
+
+  if (device_.config.atomic_check)
+    return device_.config.atomic_check(state);
+
+  return 0;
+}
+
+template <typename T>
+T *AllocArray(size_t count) {
+  return static_cast<T *>(calloc(count ? count : 1, sizeof(T)));
+}
+
+template <typename T>
+T *CopyArray(const std::vector<T> &source) {
+  T *array = AllocArray<T>(source.size());
+  if (!source.empty())
+    memcpy(array, source.data(), source.size() * sizeof(T));
+  return array;
+}
+
+}  // namespace
+
+Config DefaultConfig(uint32_t num_crtcs) {
+  Config config;
+  config.num_crtcs = num_crtcs;
+  std::vector<uint32_t> rgb_formats = {DRM_FORMAT_XRGB8888,
+                                       DRM_FORMAT_ARGB8888,
+                                       DRM_FORMAT_XBGR8888,
+                                       DRM_FORMAT_ABGR8888, DRM_FORMAT_RGB565};
+  std::vector<uint32_t> overlay_formats = rgb_formats;
+  overlay_formats.push_back(DRM_FORMAT_YUYV);
+  overlay_formats.push_back(DRM_FORMAT_UYVY);
+  overlay_formats.push_back(DRM_FORMAT_NV12);
+
+  for (uint32_t i = 0; i < num_crtcs; i++) {
+    PlaneConfig primary;
+    primary.type = DRM_PLANE_TYPE_PRIMARY;
+    primary.possible_crtcs = 1 << i;
+    primary.formats = rgb_formats;
+    config.planes.emplace_back(primary);
+
+    for (uint32_t j = 0; j < 2; j++) {
+      PlaneConfig overlay;
+      overlay.type = DRM_PLANE_TYPE_OVERLAY;
+      overlay.possible_crtcs = 1 << i;
+      overlay.formats = overlay_formats;
+      config.planes.emplace_back(overlay);
+    }
+
+    PlaneConfig cursor;
+    cursor.type = DRM_PLANE_TYPE_CURSOR;
+    cursor.possible_crtcs = 1 << i;
+    cursor.formats = {DRM_FORMAT_ARGB8888};
+    cursor.has_rotation = false;
+    config.planes.emplace_back(cursor);
+  }
+
+  return config;
+}
+
+void Configure(const Config &config) {
+  std::lock_guard<std::mutex> guard(lock_);
+  BuildDevice(config);
+}
+
+Stats GetStats() {
+  std::lock_guard<std::mutex> guard(lock_);
+  return device_.stats;
+}
+
+void ResetStats() {
+  std::lock_guard<std::mutex> guard(lock_);
+  device_.stats = Stats();
+}
+
+std::vector<PlaneState> GetCommittedPlanes() {
+  std::lock_guard<std::mutex> guard(lock_);
+  EnsureConfigured();
+  return CollectPlanes(device_.objects);
+}
+
+}  // namespace fakekms
+
+using namespace fakekms;
+
+extern "C" {
+
+int drmOpen(const char * /*name*/, const char * /*busid*/) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  EnsureConfigured();
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC | O_NONBLOCK))
+    return -1;
+
+  // Page flip events are signalled through the returned fd, so it can be
+  // polled just like a real DRM fd.
+  if (device_.event_write_fd >= 0)
+    close(device_.event_write_fd);
+  device_.event_write_fd = fds[1];
+  device_.fds.insert(fds[0]);
+  return fds[0];
+}
+
+int drmIoctl(int /*fd*/, unsigned long request, void * /*arg*/) {
+  SimulateIoctl(0);
+  if (request == DRM_IOCTL_SET_CLIENT_CAP)
+    return 0;
+
+  errno = ENOTTY;
+  return -1;
+}
+
+int drmSetClientCap(int /*fd*/, uint64_t capability, uint64_t /*value*/) {
+  SimulateIoctl(0);
+  switch (capability) {
+    case DRM_CLIENT_CAP_UNIVERSAL_PLANES:
+    case DRM_CLIENT_CAP_ATOMIC:
+      return 0;
+    default:
+      return Fail(EINVAL);
+  }
+}
+
+int drmWaitVBlank(int /*fd*/, drmVBlankPtr vbl) {
+  SimulateIoctl(0);
+  int64_t target_ns;
+  uint32_t target;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    EnsureConfigured();
+    uint32_t current = VBlankSequence(Now());
+    if (vbl->request.type & DRM_VBLANK_RELATIVE)
+      target = current + vbl->request.sequence;
+    else
+      target = vbl->request.sequence;
+
+    if (target <= current)
+      target = current + ((vbl->request.type & DRM_VBLANK_NEXTONMISS) ? 1 : 0);
+
+    target_ns = VBlankTime(target);
+    device_.stats.vblanks++;
+  }
+
+  SleepUntil(target_ns);
+  vbl->reply.sequence = target;
+  vbl->reply.tval_sec = target_ns / kOneSecondNs;
+  vbl->reply.tval_usec = (target_ns % kOneSecondNs) / 1000;
+  return 0;
+}
+
+int drmHandleEvent(int fd, drmEventContextPtr evctx) {
+  char drain[64];
+  while (read(fd, drain, sizeof(drain)) > 0) {
+  }
+
+  std::vector<PageFlipEvent> events;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    events.swap(device_.events);
+  }
+
+  for (const PageFlipEvent &event : events) {
+    SleepUntil(event.due_ns);
+    if (evctx->page_flip_handler)
+      evctx->page_flip_handler(fd, event.sequence, event.due_ns / kOneSecondNs,
+                               (event.due_ns % kOneSecondNs) / 1000,
+                               event.user_data);
+  }
+
+  return 0;
+}
+
+drmModeResPtr drmModeGetResources(int /*fd*/) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  EnsureConfigured();
+  std::vector<uint32_t> crtcs, encoders, connectors, fbs;
+  for (const Crtc &crtc : device_.crtcs) {
+    crtcs.push_back(crtc.id);
+    encoders.push_back(crtc.encoder_id);
+    connectors.push_back(crtc.connector_id);
+  }
+  for (const auto &fb : device_.framebuffers)
+    fbs.push_back(fb.first);
+
+  drmModeResPtr res = AllocArray<drmModeRes>(1);
+  res->count_fbs = fbs.size();
+  res->fbs = CopyArray(fbs);
+  res->count_crtcs = crtcs.size();
+  res->crtcs = CopyArray(crtcs);
+  res->count_connectors = connectors.size();
+  res->connectors = CopyArray(connectors);
+  res->count_encoders = encoders.size();
+  res->encoders = CopyArray(encoders);
+  res->min_width = 1;
+  res->min_height = 1;
+  res->max_width = 8192;
+  res->max_height = 8192;
+  return res;
+}
+
+void drmModeFreeResources(drmModeResPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->fbs);
+  free(ptr->crtcs);
+  free(ptr->connectors);
+  free(ptr->encoders);
+  free(ptr);
+}
+
+drmModeCrtcPtr drmModeGetCrtc(int /*fd*/, uint32_t crtc_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!FindCrtc(crtc_id)) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  drmModeCrtcPtr crtc = AllocArray<drmModeCrtc>(1);
+  crtc->crtc_id = crtc_id;
+  uint64_t active = 0;
+  GetValue(device_.objects[crtc_id], "ACTIVE", &active);
+  crtc->mode_valid = active;
+  if (active)
+    crtc->mode = device_.mode;
+  crtc->width = device_.config.width;
+  crtc->height = device_.config.height;
+  return crtc;
+}
+
+void drmModeFreeCrtc(drmModeCrtcPtr ptr) {
+  free(ptr);
+}
+
+drmModeConnectorPtr drmModeGetConnector(int /*fd*/, uint32_t connector_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  for (const Crtc &crtc : device_.crtcs) {
+    if (crtc.connector_id != connector_id)
+      continue;
+
+    const Object &object = device_.objects[connector_id];
+    std::vector<uint32_t> props;
+    std::vector<uint64_t> values;
+    for (const auto &property : object.properties) {
+      props.push_back(property.first);
+      values.push_back(property.second);
+    }
+
+    drmModeConnectorPtr connector = AllocArray<drmModeConnector>(1);
+    connector->connector_id = connector_id;
+    connector->encoder_id = crtc.encoder_id;
+    connector->connector_type = DRM_MODE_CONNECTOR_eDP;
+    connector->connector_type_id = 1;
+    connector->connection = DRM_MODE_CONNECTED;
+    connector->mmWidth = 344;
+    connector->mmHeight = 194;
+    connector->subpixel = DRM_MODE_SUBPIXEL_UNKNOWN;
+    connector->count_modes = 1;
+    connector->modes = AllocArray<drmModeModeInfo>(1);
+    connector->modes[0] = device_.mode;
+    connector->count_props = props.size();
+    connector->props = CopyArray(props);
+    connector->prop_values = CopyArray(values);
+    connector->count_encoders = 1;
+    connector->encoders = AllocArray<uint32_t>(1);
+    connector->encoders[0] = crtc.encoder_id;
+    return connector;
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+void drmModeFreeConnector(drmModeConnectorPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->modes);
+  free(ptr->props);
+  free(ptr->prop_values);
+  free(ptr->encoders);
+  free(ptr);
+}
+
+drmModeEncoderPtr drmModeGetEncoder(int /*fd*/, uint32_t encoder_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  for (size_t i = 0; i < device_.crtcs.size(); i++) {
+    if (device_.crtcs[i].encoder_id != encoder_id)
+      continue;
+
+    drmModeEncoderPtr encoder = AllocArray<drmModeEncoder>(1);
+    encoder->encoder_id = encoder_id;
+    encoder->encoder_type = DRM_MODE_ENCODER_TMDS;
+    encoder->crtc_id = device_.crtcs[i].id;
+    encoder->possible_crtcs = 1 << i;
+    return encoder;
+  }
+
+  errno = ENOENT;
+  return NULL;
+}
+
+void drmModeFreeEncoder(drmModeEncoderPtr ptr) {
+  free(ptr);
+}
+
+int drmModeConnectorSetProperty(int /*fd*/, uint32_t connector_id,
+                                uint32_t property_id, uint64_t value) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  auto object = device_.objects.find(connector_id);
+  size_t index;
+  if (object == device_.objects.end() ||
+      object->second.type != DRM_MODE_OBJECT_CONNECTOR ||
+      !object->second.Find(property_id, &index))
+    return Fail(EINVAL);
+
+  object->second.properties[index].second = value;
+  return 0;
+}
+
+drmModePlaneResPtr drmModeGetPlaneResources(int /*fd*/) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  EnsureConfigured();
+  std::vector<uint32_t> planes;
+  for (const Plane &plane : device_.planes)
+    planes.push_back(plane.id);
+
+  drmModePlaneResPtr res = AllocArray<drmModePlaneRes>(1);
+  res->count_planes = planes.size();
+  res->planes = CopyArray(planes);
+  return res;
+}
+
+void drmModeFreePlaneResources(drmModePlaneResPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->planes);
+  free(ptr);
+}
+
+drmModePlanePtr drmModeGetPlane(int /*fd*/, uint32_t plane_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  const Plane *plane = FindPlane(plane_id);
+  if (!plane) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  const Object &object = device_.objects[plane_id];
+  uint64_t crtc_id = 0, fb_id = 0;
+  GetValue(object, "CRTC_ID", &crtc_id);
+  GetValue(object, "FB_ID", &fb_id);
+
+  drmModePlanePtr drm_plane = AllocArray<drmModePlane>(1);
+  drm_plane->plane_id = plane_id;
+  drm_plane->crtc_id = crtc_id;
+  drm_plane->fb_id = fb_id;
+  drm_plane->possible_crtcs = plane->config.possible_crtcs;
+  drm_plane->count_formats = plane->config.formats.size();
+  drm_plane->formats = CopyArray(plane->config.formats);
+  return drm_plane;
+}
+
+void drmModeFreePlane(drmModePlanePtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->formats);
+  free(ptr);
+}
+
+drmModeObjectPropertiesPtr drmModeObjectGetProperties(int /*fd*/,
+                                                      uint32_t object_id,
+                                                      uint32_t object_type) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  auto object = device_.objects.find(object_id);
+  if (object == device_.objects.end() ||
+      (object_type != DRM_MODE_OBJECT_ANY &&
+       object->second.type != object_type)) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  std::vector<uint32_t> props;
+  std::vector<uint64_t> values;
+  for (const auto &property : object->second.properties) {
+    props.push_back(property.first);
+    values.push_back(property.second);
+  }
+
+  drmModeObjectPropertiesPtr properties =
+      AllocArray<drmModeObjectProperties>(1);
+  properties->count_props = props.size();
+  properties->props = CopyArray(props);
+  properties->prop_values = CopyArray(values);
+  return properties;
+}
+
+void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->props);
+  free(ptr->prop_values);
+  free(ptr);
+}
+
+drmModePropertyPtr drmModeGetProperty(int /*fd*/, uint32_t property_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  auto name = device_.property_names.find(property_id);
+  if (name == device_.property_names.end()) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  drmModePropertyPtr property = AllocArray<drmModePropertyRes>(1);
+  property->prop_id = property_id;
+  property->flags = name->second == "type" ? DRM_MODE_PROP_IMMUTABLE
+                                           : DRM_MODE_PROP_RANGE;
+  strncpy(property->name, name->second.c_str(), DRM_PROP_NAME_LEN - 1);
+  return property;
+}
+
+void drmModeFreeProperty(drmModePropertyPtr ptr) {
+  if (!ptr)
+    return;
+  free(ptr->values);
+  free(ptr->enums);
+  free(ptr->blob_ids);
+  free(ptr);
+}
+
+int drmModeAddFB2(int /*fd*/, uint32_t width, uint32_t height,
+                  uint32_t pixel_format, const uint32_t /*bo_handles*/[4],
+                  const uint32_t pitches[4], const uint32_t /*offsets*/[4],
+                  uint32_t *buf_id, uint32_t /*flags*/) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!width || !height || !pitches[0])
+    return Fail(EINVAL);
+
+  uint32_t id = device_.next_id++;
+  device_.framebuffers[id] = {width, height, pixel_format};
+  device_.stats.framebuffers_added++;
+  *buf_id = id;
+  return 0;
+}
+
+int drmModeRmFB(int /*fd*/, uint32_t buffer_id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!device_.framebuffers.erase(buffer_id))
+    return Fail(ENOENT);
+
+  device_.stats.framebuffers_removed++;
+  return 0;
+}
+
+int drmModeCreatePropertyBlob(int /*fd*/, const void *data, size_t size,
+                              uint32_t *id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  uint32_t blob_id = device_.next_id++;
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  device_.blobs[blob_id].assign(bytes, bytes + size);
+  *id = blob_id;
+  return 0;
+}
+
+int drmModeDestroyPropertyBlob(int /*fd*/, uint32_t id) {
+  SimulateIoctl(0);
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!device_.blobs.erase(id))
+    return Fail(ENOENT);
+
+  return 0;
+}
+
+drmModeAtomicReqPtr drmModeAtomicAlloc(void) {
+  return new _drmModeAtomicReq();
+}
+
+void drmModeAtomicFree(drmModeAtomicReqPtr req) {
+  delete req;
+}
+
+int drmModeAtomicAddProperty(drmModeAtomicReqPtr req, uint32_t object_id,
+                             uint32_t property_id, uint64_t value) {
+  if (!req)
+    return -EINVAL;
+
+  req->items.push_back({object_id, property_id, value});
+  return req->items.size();
+}
+
+int drmModeAtomicGetCursor(drmModeAtomicReqPtr req) {
+  if (!req)
+    return -EINVAL;
+
+  return req->items.size();
+}
+
+void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor) {
+  if (req && cursor >= 0 && (size_t)cursor < req->items.size())
+    req->items.resize(cursor);
+}
+
+int drmModeAtomicCommit(int /*fd*/, drmModeAtomicReqPtr req, uint32_t flags,
+                        void *user_data) {
+  bool test_only = flags & DRM_MODE_ATOMIC_TEST_ONLY;
+  uint32_t latency_us;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    latency_us = test_only ? device_.config.test_commit_latency_us
+                           : device_.config.commit_latency_us;
+  }
+  SimulateIoctl(latency_us);
+
+  int64_t wait_until = 0;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    EnsureConfigured();
+    std::map<uint32_t, Object> objects = device_.objects;
+    std::vector<std::pair<uint32_t, uint64_t>> out_fences;
+    std::set<uint32_t> touched_crtcs;
+    bool modeset_changed = false;
+    for (const auto &item : req->items) {
+      auto object = objects.find(item.object_id);
+      if (object == objects.end())
+        return Fail(ENOENT);
+
+      size_t index;
+      if (!object->second.Find(item.property_id, &index))
+        return Fail(EINVAL);
+
+      const std::string &name = device_.property_names[item.property_id];
+      if (name == "type")
+        return Fail(EINVAL);
+
+      uint32_t crtc_id = 0;
+      if (object->second.type == DRM_MODE_OBJECT_CRTC) {
+        crtc_id = item.object_id;
+        if (name == "OUT_FENCE_PTR") {
+          out_fences.emplace_back(item.object_id, item.value);
+          continue;
+        }
+      } else if (object->second.type == DRM_MODE_OBJECT_PLANE) {
+        if (name == "IN_FENCE_FD")
+          continue;
+        uint64_t value = 0;
+        GetValue(object->second, "CRTC_ID", &value);
+        crtc_id = name == "CRTC_ID" && item.value ? item.value : value;
+      }
+
+      if (object->second.properties[index].second != item.value &&
+          (name == "ACTIVE" || name == "MODE_ID" ||
+           (object->second.type == DRM_MODE_OBJECT_CONNECTOR &&
+            name == "CRTC_ID"))) {
+        if (name == "MODE_ID" && item.value && !device_.blobs.count(item.value))
+          return Fail(EINVAL);
+        modeset_changed = true;
+      }
+
+      if (crtc_id)
+        touched_crtcs.insert(crtc_id);
+      object->second.properties[index].second = item.value;
+    }
+
+    AtomicState state;
+    state.flags = flags;
+    state.planes = CollectPlanes(objects);
+    int ret = CheckState(objects, state, modeset_changed);
+    if (!ret && (flags & DRM_MODE_ATOMIC_NONBLOCK) &&
+        device_.config.busy_on_pending_flip) {
+      int64_t now = Now();
+      for (uint32_t crtc_id : touched_crtcs) {
+        Crtc *crtc = FindCrtc(crtc_id);
+        if (crtc && crtc->flip_pending_until > now)
+          ret = -EBUSY;
+      }
+    }
+
+    if (test_only) {
+      device_.stats.test_commits++;
+      if (ret) {
+        device_.stats.failed_test_commits++;
+        return Fail(-ret);
+      }
+      return 0;
+    }
+
+    device_.stats.commits++;
+    if (ret) {
+      device_.stats.failed_commits++;
+      return Fail(-ret);
+    }
+
+    device_.stats.committed_properties += req->items.size();
+
+    device_.objects.swap(objects);
+
+    // Signalled fences, there is no real hardware to wait for.
+    for (const auto &out_fence : out_fences) {
+      if (out_fence.second)
+        *reinterpret_cast<int32_t *>(static_cast<uintptr_t>(
+            out_fence.second)) = eventfd(1, EFD_CLOEXEC);
+    }
+
+    int64_t now = Now();
+    uint32_t sequence = VBlankSequence(now) + 1;
+    int64_t flip_ns = VBlankTime(sequence);
+    for (uint32_t crtc_id : touched_crtcs) {
+      Crtc *crtc = FindCrtc(crtc_id);
+      if (!crtc)
+        continue;
+
+      crtc->flip_pending_until = flip_ns;
+      device_.stats.page_flips++;
+      if (flags & DRM_MODE_PAGE_FLIP_EVENT)
+        device_.events.push_back({flip_ns, sequence, crtc_id, user_data});
+    }
+
+    if ((flags & DRM_MODE_PAGE_FLIP_EVENT) && device_.event_write_fd >= 0) {
+      char byte = 0;
+      if (write(device_.event_write_fd, &byte, 1) < 0)
+        fprintf(stderr, "fakekms: failed to signal page flip event.\n");
+    }
+
+    // Blocking commits return once the flip happened.
+    if (!(flags & DRM_MODE_ATOMIC_NONBLOCK))
+      wait_until = flip_ns;
+  }
+
+  if (wait_until)
+    SleepUntil(wait_until);
+
+  return 0;
+}
+
+}  // extern "C"
@@ -0,0 +1,118 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef FAKE_KMS_H_
+#define FAKE_KMS_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// In process replacement for the libdrm KMS entry points used by
+// hwcomposer. Linking fakekms.cpp into a program makes drmOpen,
+// drmModeAtomicCommit, drmModeAddFB2 and friends resolve to a modelled
+// device instead of libdrm, so DisplayPlaneManager and InternalDisplay can
+// be exercised and profiled on machines without a KMS capable GPU.
+
+namespace fakekms {
+
+struct PlaneConfig {
+  // DRM_PLANE_TYPE_*.
+  uint32_t type;
+  uint32_t possible_crtcs;
+  std::vector<uint32_t> formats;
+  bool has_rotation = true;
+  bool has_alpha = false;
+};
+
+// Plane state as it would be after applying an atomic request.
+struct PlaneState {
+  uint32_t plane_id;
+  uint32_t type;
+  std::map<std::string, uint64_t> properties;
+
+  uint64_t Get(const char *name) const {
+    auto it = properties.find(name);
+    return it == properties.end() ? 0 : it->second;
+  }
+
+  bool IsEnabled() const {
+    return Get("FB_ID") != 0 && Get("CRTC_ID") != 0;
+  }
+};
+
+struct AtomicState {
+  uint32_t flags;
+  std::vector<PlaneState> planes;
+};
+
+struct Config {
+  // One encoder and one connected connector is created per CRTC.
+  uint32_t num_crtcs = 1;
+  std::vector<PlaneConfig> planes;
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  uint32_t refresh = 60;
+
+  // Added to every call which would be an ioctl on real hardware.
+  uint32_t ioctl_latency_us = 0;
+  // Added on top of ioctl_latency_us for test and real atomic commits.
+  uint32_t test_commit_latency_us = 0;
+  uint32_t commit_latency_us = 0;
+
+  // Built in atomic check rules. Zero means no limit.
+  uint32_t max_enabled_planes_per_crtc = 0;
+  bool allow_overlay_scaling = true;
+  // Nonblocking commits fail with -EBUSY while a page flip is pending.
+  bool busy_on_pending_flip = false;
+
+  // Extra atomic check, called for test and real commits. Returns 0 or a
+  // negative errno.
+  std::function<int(const AtomicState &)> atomic_check;
+};
+
+struct Stats {
+  uint64_t ioctls = 0;
+  uint64_t test_commits = 0;
+  uint64_t failed_test_commits = 0;
+  uint64_t commits = 0;
+  uint64_t failed_commits = 0;
+  // Properties carried by successful real commits.
+  uint64_t committed_properties = 0;
+  uint64_t framebuffers_added = 0;
+  uint64_t framebuffers_removed = 0;
+  uint64_t page_flips = 0;
+  uint64_t vblanks = 0;
+};
+
+// Returns a config which roughly matches a Gen9 pipe: one primary, two
+// overlays and a cursor plane per CRTC.
+Config DefaultConfig(uint32_t num_crtcs);
+
+// Replaces the modelled device. Has to be called before drmOpen.
+void Configure(const Config &config);
+
+Stats GetStats();
+void ResetStats();
+
+// Plane state after the last successful real commit.
+std::vector<PlaneState> GetCommittedPlanes();
+
+}  // namespace fakekms
+#endif  // FAKE_KMS_H_